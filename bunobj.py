@@ -1,6 +1,9 @@
 import sys
+import struct
+
+#Converts an OBJ with v//vn faces to the binary mesh format read by uraster::MappedMesh (see uraster_mesh.hpp)
+#usage: python bunobj.py bunny.obj bunny.urmesh
 
-print("#include<stddef.h>")
 verts=[]
 faces=[]
 normals=[]
@@ -17,43 +20,30 @@ for l in open(sys.argv[1],'r'):
 		for f in lp[1:]:
 			fp=f.split('//')
 			if(fp[0] != fp[1]):
-				raise "NonMatchingIndex!"
-			nfi.append(str(int(fp[0])-1))
+				raise Exception("NonMatchingIndex!")
+			nfi.append(int(fp[0])-1)
 		faces.append(nfi)
 
-print("const float interleavedverts[6*%d]={\n" % (len(verts)))
-for vi in range(len(verts)):
-	print(','.join(verts[vi]+normals[vi])+(',' if (vi < len(verts)-1) else ''))
-print("};")
+def align64(n):
+	return (n+63) & ~63
 
-print("const size_t indices[3*%d]={\n" % (len(faces)))
-for fi in range(len(faces)):
-	print(','.join(faces[fi])+(',' if (fi < len(faces)-1) else ''))
-print("};")
+POSITION,NORMAL=0,1
+FLOAT32=0
+stride=24
+index_size=4
+header_size=8+4+4+8+8+4+4+8+8+8*8
+vertex_offset=align64(header_size)
+index_offset=align64(vertex_offset+len(verts)*stride)
 
-print("""
-#include<string.h>
-void gen_bunny_interleaved_array(
-	float* out_vertices,
-	size_t* out_indices,
-	size_t* num_vertices,
-	size_t* num_indices)
-{
-	if(num_indices)
-	{
-		*num_indices=sizeof(indices)/sizeof(indices[0]);
-	}
-	if(num_vertices)
-	{
-		*num_vertices=(sizeof(interleavedverts)/sizeof(interleavedverts[0]));
-	}
-	if(out_vertices)
-	{
-		memcpy(out_vertices,interleavedverts,sizeof(interleavedverts));
-	}
-	if(out_indices)
-	{
-		memcpy(out_indices,indices,sizeof(indices));
-	}
-}
-""")
+out=open(sys.argv[2],'wb')
+header=struct.pack('<8sIIQQIIQQ',b'URMESH1',2,stride,len(verts),3*len(faces),index_size,0,vertex_offset,index_offset)
+header+=struct.pack('<BBBBI',POSITION,FLOAT32,3,0,0)
+header+=struct.pack('<BBBBI',NORMAL,FLOAT32,3,0,12)
+header+=b'\0'*(vertex_offset-len(header))
+out.write(header)
+for vi in range(len(verts)):
+	out.write(struct.pack('<6f',*[float(c) for c in verts[vi]+normals[vi]]))
+out.write(b'\0'*(index_offset-(vertex_offset+len(verts)*stride)))
+for fi in faces:
+	out.write(struct.pack('<3I',*fi))
+out.close()
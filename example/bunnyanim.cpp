@@ -1,4 +1,6 @@
 #include<uraster.hpp>
+#include<uraster_mesh.hpp>
+#include<uraster_texture.hpp>
 #include<functional>
 #include<chrono>
 #define cimg_use_xshm
@@ -39,14 +41,8 @@ struct BunnyVertVsOut
 	}
 };
 
-class BunnyPixel
-{
-public:
-	Eigen::Vector4f color;
-	float& depth() { return color[3]; }
-	BunnyPixel():color(0.0f,0.0f,0.0f,-1e10f)
-	{}
-};
+//one value for each of the red, green and blue planes of the display image
+typedef std::tuple<uint8_t,uint8_t,uint8_t> BunnyPixel;
 
 BunnyVertVsOut example_vertex_shader(const BunnyVert& vin,const Eigen::Matrix4f& mvp,float t)
 {
@@ -60,88 +56,66 @@ BunnyVertVsOut example_vertex_shader(const BunnyVert& vin,const Eigen::Matrix4f&
 	return vout;
 }
 
-BunnyPixel example_fragment_shader(const BunnyVertVsOut& fsin,const CImg<uint8_t>& tex1,float t)
+BunnyPixel example_fragment_shader(const BunnyVertVsOut& fsin,const uraster::Texture<uint8_t,3>& tex1,float t)
 {
-	BunnyPixel p;
-	
-	Eigen::Vector2f tc(fsin.tc[0]*tex1.width()*0.4f,fsin.tc[1]*tex1.height()*0.4f);
-	Eigen::Vector3f diffuse;
-	for(int c=0;c<3;c++)
-	{
-		diffuse[c]=tex1.linear_atXY(tc[0],tc[1],0,c)/255.0f;
-	}
+	//all three channels come back from one sample
+	Eigen::Vector3f diffuse=tex1.sample_bilinear(fsin.tc[0]*0.4f,fsin.tc[1]*0.4f).matrix();
 	float theta=1.2f*sin(t);
 	Eigen::Vector3f ld(1.0,sin(theta),cos(theta));
 	float intensity=ld.normalized().dot(fsin.n);
-	p.color.head<3>()=diffuse*intensity;
-	return p;
+	Eigen::Vector3f color=(diffuse*intensity*255.0f).cwiseMax(0.0f).cwiseMin(255.0f);
+	return BunnyPixel(color[0],color[1],color[2]);
 }
 
+//The bunny is rendered straight into the color planes of the CImg image that gets displayed, next to a separate depth buffer,
+//so there is no conversion pass between rendering and display.
 class BunnyDisplay
 {
 public:
+	typedef uraster::FramebufferView<uint8_t> Plane;
 	CImg<uint8_t> backing;
 	CImgDisplay window;
+	uraster::Framebuffer<float> depth;
+	Plane red,green,blue;
+	uraster::RenderTargets<uraster::Framebuffer<float>,Plane,Plane,Plane> targets;
 public:
 	BunnyDisplay(size_t width,size_t height,const std::string& title="Rendering the bunny"):
-		backing(width,height,1,3),
-		window(width,height,title.c_str(),0)
+		backing(width,height,1,3,0),
+		window(width,height,title.c_str(),0),
+		depth(width,height,-1e10f),
+		red(backing.data(0,0,0,0),width,height),
+		green(backing.data(0,0,0,1),width,height),
+		blue(backing.data(0,0,0,2),width,height),
+		targets(depth,red,green,blue)
 	{}
 
-	void render_framebuffer(const uraster::Framebuffer<BunnyPixel>& fb)
+	void render_framebuffer()
 	{
-		const float* fbdata=&(fb(0,0).color[0]);
-		uint8_t* pixels=backing.data();
-		#pragma omp parallel for
-		for(size_t y=0;y<fb.height;y++)
-		for(size_t x=0;x<fb.width;x++)
-		{
-			const float* fbp=fbdata+4*(y*fb.width+x);
-			for(int c=0;c<3;c++)
-			{
-				backing(x,y,c)=std::max(0.0f,std::min(fbp[c]*255.0f,255.0f));
-			}
-		}
-
-		//std::cerr << "Postprocessing complete.  Writing to file" << endl;
 		window.display(backing);
 	}
+	void clear()
+	{
+		depth.clear(-1e10f);
+		backing.fill(0);
+	}
 	void wait()
 	{
 		window.wait();
 	}
 };
 
-extern "C"
-{
-void gen_bunny_interleaved_array(
-	float* out_vertices,
-	size_t* out_indices,
-	size_t* num_vertices,
-	size_t* num_indices);
-}
-
-int main()
+int main(int argc,char** argv)
 {
-	size_t num_bunny_indices;
-	size_t num_bunny_vertices;
-	gen_bunny_interleaved_array(NULL,NULL,&num_bunny_vertices,&num_bunny_indices);
-	std::unique_ptr<size_t[]> bunny_inds(new size_t[num_bunny_indices]);
-	std::unique_ptr<float []> bunny_verts_f(new float[6*num_bunny_vertices]);
-	gen_bunny_interleaved_array(reinterpret_cast<float*>(bunny_verts_f.get()),bunny_inds.get(),NULL,NULL);
-	std::unique_ptr<BunnyVert[]> bunny_verts(new BunnyVert[num_bunny_vertices]);
+	//the vertices and indices are used straight out of the mapped file
+	uraster::MappedMesh bunny(argc > 1 ? argv[1] : "example/bunny.urmesh");
+	size_t num_bunny_vertices=bunny.num_vertices();
+	size_t num_bunny_indices=bunny.num_indices();
 	std::unique_ptr<BunnyVertVsOut[]> bunny_vc(new BunnyVertVsOut[num_bunny_vertices]);
-	
-	for(size_t i=0;i<num_bunny_vertices;i++)
-	{
-		const float* bv=&bunny_verts_f[6*i];
-		bunny_verts[i]={bv[0],bv[1],bv[2],bv[3],bv[4],bv[5]};
-	}
 
-	const BunnyVert* vbb=bunny_verts.get();
-	const BunnyVert* vbe=bunny_verts.get()+num_bunny_vertices;
-	const size_t* ibb=bunny_inds.get();
-	const size_t* ibe=bunny_inds.get()+num_bunny_indices;
+	const BunnyVert* vbb=bunny.vertices<BunnyVert>();
+	const BunnyVert* vbe=vbb+num_bunny_vertices;
+	const uint32_t* ibb=bunny.indices<uint32_t>();
+	const uint32_t* ibe=ibb+num_bunny_indices;
 
 	BunnyVertVsOut* vcb=bunny_vc.get();
 	BunnyVertVsOut* vce=bunny_vc.get()+num_bunny_vertices;
@@ -155,12 +129,15 @@ int main()
 	model(0,3)=0.2;
 	model(1,3)=0.5;
 
-	CImg<uint8_t> woodtex("example/woodgrain.jpg");
+	CImg<uint8_t> woodimg("example/woodgrain.jpg");
+	//CImg stores its channels as planes
+	uraster::Texture<uint8_t,3> woodtex(woodimg.width(),woodimg.height(),woodimg.data(),
+		1,woodimg.width(),woodimg.width()*woodimg.height(),
+		true,uraster::TextureWrap::CLAMP);
 
 	float time=0.0;
 
-	uraster::Framebuffer<BunnyPixel> tp(640,480);
-	BunnyDisplay disp(tp.width,tp.height);
+	BunnyDisplay disp(640,480);
 
         auto start = std::chrono::high_resolution_clock::now();
 	std::size_t numframes=0;
@@ -177,7 +154,7 @@ int main()
 		view(3,3)=view(1,1)=1.0f;
 
 		Eigen::Matrix4f camera_matrix=view*model;
-		uraster::draw(tp,
+		uraster::draw(disp.targets,
 			vbb,vbe,
 			ibb,ibe,
 			vcb,vce,
@@ -187,8 +164,8 @@ int main()
 
 		numframes++;
 		disp.window.set_title("Rendering %f",static_cast<float>(numframes)/nowtime.count());
-		disp.render_framebuffer(tp);
-		tp.clear();
+		disp.render_framebuffer();
+		disp.clear();
 
 	}
         auto end = std::chrono::high_resolution_clock::now();
@@ -1,4 +1,5 @@
 #include<uraster.hpp>
+#include<uraster_mesh.hpp>
 #include<functional>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include"stb_image_write.h"
@@ -57,6 +58,14 @@ BunnyPixel example_fragment_shader(const BunnyVertVsOut& fsin)
 	return p;
 }
 
+//average the 4 MSAA samples of a pixel
+BunnyPixel resolve_samples(const BunnyPixel* samples)
+{
+	BunnyPixel p;
+	p.color=(samples[0].color+samples[1].color+samples[2].color+samples[3].color)*0.25f;
+	return p;
+}
+
 void write_framebuffer(const uraster::Framebuffer<BunnyPixel>& fb,const std::string& filename)
 {
 	uint8_t* pixels=new uint8_t[fb.width*fb.height*3];
@@ -79,35 +88,17 @@ void write_framebuffer(const uraster::Framebuffer<BunnyPixel>& fb,const std::str
 	}
 }
 
-extern "C"
+int main(int argc,char** argv)
 {
-void gen_bunny_interleaved_array(
-	float* out_vertices,
-	size_t* out_indices,
-	size_t* num_vertices,
-	size_t* num_indices);
-}
-
-int main()
-{
-	size_t num_bunny_indices;
-	size_t num_bunny_vertices;
-	gen_bunny_interleaved_array(NULL,NULL,&num_bunny_vertices,&num_bunny_indices);
-	std::unique_ptr<size_t[]> bunny_inds(new size_t[num_bunny_indices]);
-	std::unique_ptr<float []> bunny_verts_f(new float[6*num_bunny_vertices]);
-	gen_bunny_interleaved_array(reinterpret_cast<float*>(bunny_verts_f.get()),bunny_inds.get(),NULL,NULL);
-	std::unique_ptr<BunnyVert[]> bunny_verts(new BunnyVert[num_bunny_vertices]);
-	
-	for(size_t i=0;i<num_bunny_vertices;i++)
-	{
-		const float* bv=&bunny_verts_f[6*i];
-		bunny_verts[i]={bv[0],bv[1],bv[2],bv[3],bv[4],bv[5]};
-	}
+	//the vertices and indices are used straight out of the mapped file
+	uraster::MappedMesh bunny(argc > 1 ? argv[1] : "example/bunny.urmesh");
+	size_t num_bunny_vertices=bunny.num_vertices();
+	size_t num_bunny_indices=bunny.num_indices();
 
-	const BunnyVert* vbb=bunny_verts.get();
-	const BunnyVert* vbe=bunny_verts.get()+num_bunny_vertices;
-	const size_t* ibb=bunny_inds.get();
-	const size_t* ibe=bunny_inds.get()+num_bunny_indices;
+	const BunnyVert* vbb=bunny.vertices<BunnyVert>();
+	const BunnyVert* vbe=vbb+num_bunny_vertices;
+	const uint32_t* ibb=bunny.indices<uint32_t>();
+	const uint32_t* ibe=ibb+num_bunny_indices;
 
 	Eigen::Matrix4f model=Eigen::Matrix4f::Identity();
 	
@@ -123,14 +114,17 @@ int main()
 	
 	float time=0.0;
 
-	uraster::Framebuffer<BunnyPixel> tp(640<<2,480<<2);
-	uraster::draw(tp,
+	//4x MSAA instead of rendering at 4x the resolution: the fragment shader only runs once per pixel
+	uraster::MultisampleFramebuffer<BunnyPixel,4> ms(640,480);
+	uraster::draw(ms,
 		vbb,vbe,
 		ibb,ibe,
 		(BunnyVertVsOut*)NULL,(BunnyVertVsOut*)NULL,
 		std::bind(example_vertex_shader,placeholders::_1,camera_matrix,time),
 		example_fragment_shader
 	);
+	uraster::Framebuffer<BunnyPixel> tp(ms.width,ms.height);
+	uraster::resolve(ms,tp,resolve_samples);
 	std::cerr << "Rendering complete.  Postprocessing." << endl;
 	write_framebuffer(tp,"out.png");
 	return 0;
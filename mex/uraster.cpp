@@ -26,7 +26,6 @@
 #include "mex.h"
 #include "matrix.h"
 #include "uraster_mex.hpp"
-#include <vector>
 
 /* The gateway function */
 void mexFunction( int nlhs, mxArray *plhs[],
@@ -60,14 +59,7 @@ void mexFunction( int nlhs, mxArray *plhs[],
 	}
 	/* faces = mxGetInt32s(prhs[0]); if newer matlab... */
 	intFaces = (int*)mxGetData(prhs[0]);
-	std::vector<size_t> faces(intFaces, intFaces + (mfaces * 3));
-
-	/* all faces -1 since matlab indexes at 1 but uraster indexes at 0 */
-	/*#pragma omp parallel for
-	for(size_t f=0; f < faces.size(); f++)
-	{
-		faces[f]--;
-	}*/
+	/* the int32 faces are used as the index buffer directly */
 	
 	size_t npositions = mxGetN(prhs[1]);
 	size_t npositions_cols = mxGetM(prhs[1]);
@@ -129,7 +121,7 @@ void mexFunction( int nlhs, mxArray *plhs[],
 	}
 
 	/*
-	size_t num_faces,std::size_t* faces,
+	size_t num_faces,const IndexType* faces,
 	size_t num_vertices,
 	const PFloat* positions,size_t num_pdims,
 	const AFloat* attributes,size_t num_attrs,
@@ -139,5 +131,5 @@ void mexFunction( int nlhs, mxArray *plhs[],
 	AFloat* outdata,
 	int* outmask*/
 	/* Call rasterization routine */
-	Mex<float,float>::uraster_cpp(mfaces * 3, faces.data(), npositions, positions, npositions_cols, attributes, kattributes, eigenCamera, rows, columns, images, mask);
+	Mex<float,float>::uraster_cpp(mfaces * 3, intFaces, npositions, positions, npositions_cols, attributes, kattributes, eigenCamera, rows, columns, images, mask);
 }
@@ -12,68 +12,32 @@ struct Vert
 	const AFloat* attribute_ptr;
 };
 
-class Pixel
-{
-public:
-	int drawn;
-	float _depth;
-	
-	float& depth() {return _depth;}
-	Eigen::Matrix<AFloat,1,Eigen::Dynamic> attrs;
-
-	Pixel(size_t num_attr):
-		drawn(0),_depth(-1e16f),
-		attrs(Eigen::Matrix<AFloat,1,Eigen::Dynamic>::Zero(num_attr))
-	{}
-};
-
-struct VertVsOut
-{
-	Eigen::Matrix<PFloat,4,1> p;
-	Eigen::Matrix<AFloat,1,Eigen::Dynamic> attrs;
-
-	VertVsOut(size_t num_attr=0):
-		p(0.0f,0.0f,0.0f,0.0f),
-		attrs(Eigen::Matrix<AFloat,1,Eigen::Dynamic>::Zero(num_attr))
-	{}
-	const Eigen::Matrix<PFloat,4,1>& position() const
-	{
-		return p;
-	}
-	VertVsOut& operator+=(const VertVsOut& tp)
-	{
-		p+=tp.p;
-		attrs+=tp.attrs;
-		return *this;
-	}
-	VertVsOut& operator*=(const float& f)
-	{
-		p*=f;attrs*=f;return *this;
-	}
-};
+//the attributes are written straight into the planes of MATLAB's rows x columns x k output
+typedef uraster::PlanarFramebuffer<AFloat> Framebuffer;
+typedef typename Framebuffer::PlanarPixel Pixel;
 
+//The varyings point straight at each vertex's attributes and are interpolated in per-thread scratch, so nothing is copied or allocated per vertex or per fragment
+typedef uraster::VaryingVertex<AFloat> VertVsOut;
 
 static VertVsOut mex_vertex_shader(const Vert& vin,const Eigen::Matrix<PFloat,4,4>& mvp)
 {
-	VertVsOut vout(vin.num_attributes);
 	Eigen::Matrix<PFloat,4,1> pin(0.0f,0.0f,0.0f,1.0f);
 	std::copy(vin.position_ptr,vin.position_ptr+vin.num_positions,pin.data());
-	vout.p=mvp*pin;
-	
-	std::copy(vin.attribute_ptr,vin.attribute_ptr+vin.num_attributes,vout.attrs.data());
-	return vout;
+	return VertVsOut((mvp*pin).template cast<float>(),vin.attribute_ptr,vin.num_attributes);
 }
 
-static Pixel mex_fragment_shader(const VertVsOut& fsin)
+static void mex_fragment_shader(const VertVsOut& fsin,Pixel& p,int* outmask)
 {
-	Pixel p(fsin.attrs.cols());
-	p.drawn=1;
-	p.attrs=fsin.attrs;
-	return p;
+	for(size_t k=0;k<fsin.num_varyings;k++)
+	{
+		p[k]=fsin[k];
+	}
+	outmask[p.index()]=1;
 }
 
+template<class IndexType>
 static void uraster_cpp(
-	size_t num_indices,std::size_t* indices,
+	size_t num_indices,const IndexType* indices,
 	size_t num_vertices,
 	const PFloat* positions,size_t num_pdims,
 	const AFloat* attributes,size_t num_attrs,
@@ -99,32 +63,15 @@ static void uraster_cpp(
 	//NOTE: because the vertex has a default constructor you can use the null vertex cache here
 	//MexVertsVsOut<PFloat,AFloat>* nullmvvo=nullptr;
 	VertVsOut* nulmvvo=nullptr;
-	uraster::Framebuffer<Pixel> tp(num_img_cols,num_img_rows,Pixel(num_attrs));
+	//MATLAB arrays are column-major, so x steps over whole columns of rows.  The outputs start zeroed, which is what undrawn pixels get.
+	Framebuffer tp(outdata,num_img_cols,num_img_rows,num_attrs,num_img_rows,1,num_img_rows*num_img_cols,-1e16f);
 	uraster::draw(tp,
 		mv.data(),mv.data()+mv.size(),
 		indices,indices+num_indices,
 		nulmvvo,nulmvvo,
 		std::bind(mex_vertex_shader,std::placeholders::_1,camera),
-		mex_fragment_shader
+		std::bind(mex_fragment_shader,std::placeholders::_1,std::placeholders::_2,outmask)
 	);
-
-	//writeback step
-	#pragma omp parallel for
-	for(size_t r=0;r < num_img_rows;r++)
-	{
-		for(size_t c=0;c < num_img_cols;c++)
-		{
-			const Pixel& px=tp(c,r);
-			size_t outoff=c*num_img_rows+r;
-			outmask[outoff]=px.drawn;
-			size_t imsize=num_img_rows*num_img_cols;
-			size_t pc = px.attrs.cols();
-			for(size_t k=0;k < pc; k++)
-			{
-				outdata[k*imsize+outoff]=px.attrs[k];
-			}
-		}
-	}
 } 
 };
 /*
@@ -8,41 +8,414 @@
 #include<array>
 #include<memory>
 #include<functional>
+#include<algorithm>
+#include<tuple>
+#include<cstdint>
+#include<atomic>
+#include<cstring>
+#include<cmath>
+#include<limits>
+#include<type_traits>
+#include<stdexcept>
+#ifdef _OPENMP
+#include<omp.h>
+#endif
 
 namespace uraster
 {
 
 
+//These are the pixel orders a Framebuffer can store its pixels in.  A layout maps a pixel coordinate to an index into the pixel array,
+//and reports how many pixels starting at (x,y) run contiguously along the row so the conversion kernels can copy whole runs at once.
+
+//Plain row-major order.  This is the default.
+struct RowMajorLayout
+{
+	std::size_t width;
+	std::size_t height;
+	RowMajorLayout(std::size_t w,std::size_t h):
+		width(w),height(h)
+	{}
+	std::size_t size() const
+	{
+		return width*height;
+	}
+	std::size_t index(std::size_t x,std::size_t y) const
+	{
+		return y*width+x;
+	}
+	std::size_t run(std::size_t x) const
+	{
+		return width-x;
+	}
+};
+
+//Tile-major order.  Each TileSize x TileSize tile is contiguous (row-major inside the tile) and the tiles are in row-major order,
+//so a triangle or a raster thread working on one tile touches a few pages instead of TileSize of them.
+//The image is padded up to a whole number of tiles.
+template<unsigned int TileSize>
+struct TiledLayout
+{
+	static_assert((TileSize & (TileSize-1))==0,"TiledLayout needs a power of two tile size");
+	std::size_t width;
+	std::size_t height;
+	std::size_t tiles_x;
+	std::size_t tiles_y;
+	TiledLayout(std::size_t w,std::size_t h):
+		width(w),height(h),
+		tiles_x((w+TileSize-1)/TileSize),tiles_y((h+TileSize-1)/TileSize)
+	{}
+	std::size_t size() const
+	{
+		return tiles_x*tiles_y*TileSize*TileSize;
+	}
+	std::size_t index(std::size_t x,std::size_t y) const
+	{
+		return ((y/TileSize)*tiles_x+x/TileSize)*TileSize*TileSize+(y%TileSize)*TileSize+x%TileSize;
+	}
+	std::size_t run(std::size_t x) const
+	{
+		return std::min<std::size_t>(TileSize-x%TileSize,width-x);
+	}
+};
+
+//Like TiledLayout but the pixels inside each tile are in Morton (Z) order, so any 2x2, 4x4... aligned block is contiguous as well.
+template<unsigned int TileSize>
+struct MortonLayout: public TiledLayout<TileSize>
+{
+	MortonLayout(std::size_t w,std::size_t h):
+		TiledLayout<TileSize>(w,h)
+	{}
+	//spreads the low 16 bits of v out to the even bits
+	static std::size_t part1by1(std::size_t v)
+	{
+		v&=0x0000FFFF;
+		v=(v | (v << 8)) & 0x00FF00FF;
+		v=(v | (v << 4)) & 0x0F0F0F0F;
+		v=(v | (v << 2)) & 0x33333333;
+		v=(v | (v << 1)) & 0x55555555;
+		return v;
+	}
+	std::size_t index(std::size_t x,std::size_t y) const
+	{
+		return ((y/TileSize)*this->tiles_x+x/TileSize)*TileSize*TileSize+part1by1(x%TileSize)+(part1by1(y%TileSize) << 1);
+	}
+	std::size_t run(std::size_t x) const
+	{
+		return (x & 1) || x+1==this->width ? 1 : 2;
+	}
+};
+
 //This is the framebuffer class.  It's a part of namespace uraster because the uraster needs to have a well-defined image class to render to.
 //It is templated because the output type need not be only colors, could contain anything (like a stencil buffer or depth buffer or gbuffer for deferred rendering)
-template<class PixelType>
+//Layout picks the order the pixels are stored in.  Use to_row_major() to read back a framebuffer that isn't row-major.
+template<class PixelType,class Layout=RowMajorLayout>
 class Framebuffer
 {
 protected:
+	Layout layout;
 	std::vector<PixelType> data;
 public:
 	const std::size_t width;
 	const std::size_t height;
 	//constructor initializes the array
 	Framebuffer(std::size_t w,std::size_t h,const PixelType& pt=PixelType()):
-		data(w*h,pt),
+		layout(w,h),
+		data(layout.size(),pt),
 		width(w),height(h)
 	{}
 	//2D pixel access
 	PixelType& operator()(std::size_t x,std::size_t y)
 	{
-		return data[y*width+x];
+		return data[layout.index(x,y)];
 	}
 	//const version
 	const PixelType& operator()(std::size_t x,std::size_t y) const
 	{
-		return data[y*width+x];
+		return data[layout.index(x,y)];
+	}
+	void clear(const PixelType& pt=PixelType())
+	{
+		std::fill(data.begin(),data.end(),pt);
+	}
+	const Layout& get_layout() const
+	{
+		return layout;
+	}
+};
+
+//This is a framebuffer that renders into memory owned by someone else, like a CImg image, a MATLAB array or a memory mapped file,
+//so there is nothing to copy out afterwards.  The strides are in bytes, so a view can step over pixels that are interleaved
+//with other data, read a column-major array (xstride=height*sizeof(PixelType), ystride=sizeof(PixelType)) or run bottom-up with a negative ystride.
+//A planar image is one view per plane combined with RenderTargets.
+template<class PixelType>
+class FramebufferView
+{
+protected:
+	uint8_t* base;
+	std::ptrdiff_t xstride;
+	std::ptrdiff_t ystride;
+public:
+	const std::size_t width;
+	const std::size_t height;
+	//ystride defaults to tightly packed rows
+	FramebufferView(PixelType* data,std::size_t w,std::size_t h,
+		std::ptrdiff_t xs=sizeof(PixelType),std::ptrdiff_t ys=0):
+		base(reinterpret_cast<uint8_t*>(data)),
+		xstride(xs),ystride(ys ? ys : xs*static_cast<std::ptrdiff_t>(w)),
+		width(w),height(h)
+	{}
+	PixelType& operator()(std::size_t x,std::size_t y)
+	{
+		return *reinterpret_cast<PixelType*>(base+static_cast<std::ptrdiff_t>(x)*xstride+static_cast<std::ptrdiff_t>(y)*ystride);
+	}
+	const PixelType& operator()(std::size_t x,std::size_t y) const
+	{
+		return *reinterpret_cast<const PixelType*>(base+static_cast<std::ptrdiff_t>(x)*xstride+static_cast<std::ptrdiff_t>(y)*ystride);
+	}
+	void clear(const PixelType& pt=PixelType())
+	{
+		#pragma omp parallel for
+		for(std::size_t y=0;y<height;y++)
+		for(std::size_t x=0;x<width;x++)
+		{
+			(*this)(x,y)=pt;
+		}
+	}
+};
+
+//This is a framebuffer that only allocates memory for the TileSize x TileSize tiles that are actually drawn to.  Every other pixel
+//reads back as the clear pixel, so a mask or thumbnail that covers a small part of a huge canvas costs memory and clear time in
+//proportion to what it covers.  A tile is allocated the first time a pixel in it is accessed through the non-const accessor, which is safe
+//to do from several threads at once.  Use for_each_tile() to read back only the allocated tiles.
+template<class PixelType,unsigned int TileSize=32>
+class SparseFramebuffer
+{
+protected:
+	PixelType clear_pixel;
+	std::unique_ptr<std::atomic<PixelType*>[]> tiles;
+
+	PixelType* allocate(std::size_t t)
+	{
+		PixelType* nt=new PixelType[TileSize*TileSize];
+		std::fill(nt,nt+TileSize*TileSize,clear_pixel);
+		PixelType* expected=nullptr;
+		if(!tiles[t].compare_exchange_strong(expected,nt))
+		{
+			//another thread allocated this tile first
+			delete [] nt;
+			return expected;
+		}
+		return nt;
+	}
+	void release()
+	{
+		for(std::size_t t=0;t<tiles_x*tiles_y;t++)
+		{
+			delete [] tiles[t].exchange(nullptr);
+		}
+	}
+public:
+	const std::size_t width;
+	const std::size_t height;
+	const std::size_t tiles_x;
+	const std::size_t tiles_y;
+
+	SparseFramebuffer(std::size_t w,std::size_t h,const PixelType& pt=PixelType()):
+		clear_pixel(pt),
+		tiles(new std::atomic<PixelType*>[((w+TileSize-1)/TileSize)*((h+TileSize-1)/TileSize)]),
+		width(w),height(h),
+		tiles_x((w+TileSize-1)/TileSize),tiles_y((h+TileSize-1)/TileSize)
+	{
+		for(std::size_t t=0;t<tiles_x*tiles_y;t++)
+		{
+			tiles[t].store(nullptr);
+		}
+	}
+	SparseFramebuffer(const SparseFramebuffer&)=delete;
+	SparseFramebuffer& operator=(const SparseFramebuffer&)=delete;
+	~SparseFramebuffer()
+	{
+		release();
+	}
+	//2D pixel access.  This allocates the pixel's tile if it hasn't been touched yet.
+	PixelType& operator()(std::size_t x,std::size_t y)
+	{
+		std::size_t t=(y/TileSize)*tiles_x+x/TileSize;
+		PixelType* tp=tiles[t].load(std::memory_order_acquire);
+		if(!tp)
+		{
+			tp=allocate(t);
+		}
+		return tp[(y%TileSize)*TileSize+x%TileSize];
+	}
+	//const version.  Pixels in untouched tiles are the clear pixel.
+	const PixelType& operator()(std::size_t x,std::size_t y) const
+	{
+		const PixelType* tp=tiles[(y/TileSize)*tiles_x+x/TileSize].load(std::memory_order_acquire);
+		return tp ? tp[(y%TileSize)*TileSize+x%TileSize] : clear_pixel;
+	}
+	//Frees every tile, so this costs nothing for tiles that were never drawn.
+	void clear(const PixelType& pt=PixelType())
+	{
+		release();
+		clear_pixel=pt;
+	}
+	bool touched(std::size_t tx,std::size_t ty) const
+	{
+		return tiles[ty*tiles_x+tx].load(std::memory_order_acquire) != nullptr;
+	}
+	std::size_t num_touched() const
+	{
+		std::size_t n=0;
+		for(std::size_t t=0;t<tiles_x*tiles_y;t++)
+		{
+			n+=tiles[t].load(std::memory_order_acquire) != nullptr;
+		}
+		return n;
+	}
+	//Calls f(x0,y0,pixels) for every allocated tile in row-major tile order, where (x0,y0) is the tile's upper left pixel and pixels
+	//holds its TileSize*TileSize pixels row by row.  Rows and columns of edge tiles past the image size are padding.
+	template<class TileFunc>
+	void for_each_tile(TileFunc f) const
+	{
+		for(std::size_t t=0;t<tiles_x*tiles_y;t++)
+		{
+			const PixelType* tp=tiles[t].load(std::memory_order_acquire);
+			if(tp)
+			{
+				f((t%tiles_x)*TileSize,(t/tiles_x)*TileSize,tp);
+			}
+		}
+	}
+};
+
+//These convert between a framebuffer in any layout and a plain row-major array of width*height pixels, copying runs of contiguous pixels in parallel.
+template<class PixelType,class Layout,class PixelOut>
+void to_row_major(const Framebuffer<PixelType,Layout>& fb,PixelOut* out)
+{
+	const Layout& l=fb.get_layout();
+	#pragma omp parallel for
+	for(std::size_t y=0;y<fb.height;y++)
+	{
+		for(std::size_t x=0;x<fb.width;)
+		{
+			std::size_t n=l.run(x);
+			const PixelType* src=&fb(x,y);
+			std::copy(src,src+n,out+y*fb.width+x);
+			x+=n;
+		}
+	}
+}
+template<class PixelType,class Layout,class PixelIn>
+void from_row_major(const PixelIn* in,Framebuffer<PixelType,Layout>& fb)
+{
+	const Layout& l=fb.get_layout();
+	#pragma omp parallel for
+	for(std::size_t y=0;y<fb.height;y++)
+	{
+		for(std::size_t x=0;x<fb.width;)
+		{
+			std::size_t n=l.run(x);
+			const PixelIn* src=in+y*fb.width+x;
+			std::copy(src,src+n,&fb(x,y));
+			x+=n;
+		}
+	}
+}
+
+//This is a multisample framebuffer.  It stores Samples (2, 4 or 8) complete pixels for every pixel position, each with its own depth,
+//which are combined into an ordinary Framebuffer with resolve() once rendering is finished.
+template<class PixelType,unsigned int Samples>
+class MultisampleFramebuffer
+{
+	static_assert(Samples==2 || Samples==4 || Samples==8,"MultisampleFramebuffer supports 2, 4 or 8 samples");
+protected:
+	std::vector<PixelType> data;
+public:
+	const std::size_t width;
+	const std::size_t height;
+	MultisampleFramebuffer(std::size_t w,std::size_t h,const PixelType& pt=PixelType()):
+		data(w*h*Samples,pt),
+		width(w),height(h)
+	{}
+	//Access one sample of a pixel
+	PixelType& operator()(std::size_t x,std::size_t y,std::size_t s)
+	{
+		return data[(y*width+x)*Samples+s];
+	}
+	const PixelType& operator()(std::size_t x,std::size_t y,std::size_t s) const
+	{
+		return data[(y*width+x)*Samples+s];
 	}
 	void clear(const PixelType& pt=PixelType())
 	{
 		std::fill(data.begin(),data.end(),pt);
 	}
+	//Position of sample s relative to the pixel position, in pixels.  These are the standard D3D sample patterns.
+	static float offset(unsigned int s,int axis)
+	{
+		static const signed char p2[2][2]={{4,4},{-4,-4}};
+		static const signed char p4[4][2]={{-2,-6},{6,-2},{-6,2},{2,6}};
+		static const signed char p8[8][2]={{1,-3},{-1,3},{5,1},{-3,-5},{-5,5},{-7,-1},{3,7},{7,-7}};
+		const signed char* p=Samples==2 ? p2[s] : (Samples==4 ? p4[s] : p8[s]);
+		return p[axis]/16.0f;
+	}
+};
+
+//This combines the samples of each pixel into one output pixel in parallel.  resolve_op is called with a pointer to the Samples samples
+//of a pixel and returns the resolved pixel, so it can average colors, keep the nearest depth, or count coverage as the pixel type needs.
+template<class PixelType,unsigned int Samples,class PixelOut,class Layout,class ResolveOp>
+void resolve(const MultisampleFramebuffer<PixelType,Samples>& ms,Framebuffer<PixelOut,Layout>& fb,ResolveOp resolve_op)
+{
+	#pragma omp parallel for
+	for(std::size_t y=0;y<ms.height;y++)
+	for(std::size_t x=0;x<ms.width;x++)
+	{
+		fb(x,y)=resolve_op(&ms(x,y,0));
+	}
+}
+
+//This is a set of render targets for drawing to several framebuffers at once (a G-buffer).  There is one depth buffer, which holds
+//plain depth values (so the depth test only touches 4 bytes per pixel), and any number of color buffers with independent pixel types.
+//Each buffer stays contiguous on its own.  The fragment shader returns a std::tuple with one value per color buffer, in order.
+//The buffers can be any framebuffer type with a (x,y) accessor, and they must all be at least as big as the depth buffer.
+template<class DepthBuffer,class... ColorBuffers>
+class RenderTargets
+{
+public:
+	DepthBuffer& depth;
+	std::tuple<ColorBuffers&...> colors;
+	const std::size_t width;
+	const std::size_t height;
+
+	RenderTargets(DepthBuffer& db,ColorBuffers&... cbs):
+		depth(db),
+		colors(cbs...),
+		width(db.width),height(db.height)
+	{}
+	//Write each element of a fragment shader's output tuple to its buffer
+	template<class Fragment>
+	void write(std::size_t x,std::size_t y,const Fragment& f)
+	{
+		write_each(x,y,f,std::integral_constant<std::size_t,0>());
+	}
+protected:
+	template<class Fragment,std::size_t I>
+	void write_each(std::size_t x,std::size_t y,const Fragment& f,std::integral_constant<std::size_t,I>)
+	{
+		std::get<I>(colors)(x,y)=std::get<I>(f);
+		write_each(x,y,f,std::integral_constant<std::size_t,I+1>());
+	}
+	template<class Fragment>
+	void write_each(std::size_t,std::size_t,const Fragment&,std::integral_constant<std::size_t,sizeof...(ColorBuffers)>)
+	{}
 };
+template<class DepthBuffer,class... ColorBuffers>
+RenderTargets<DepthBuffer,ColorBuffers...> make_render_targets(DepthBuffer& db,ColorBuffers&... cbs)
+{
+	return RenderTargets<DepthBuffer,ColorBuffers...>(db,cbs...);
+}
 
 //This function runs the vertex shader on all the vertices, producing the varyings that will be interpolated by the rasterizer.
 //VertexVsIn can be anything, VertexVsOut MUST have a position() method that returns a 4D vector, and it must have an overloaded *= and += operator for the interpolation
@@ -58,6 +431,182 @@ void run_vertex_shader(const VertexVsIn* b,const VertexVsIn* e,VertexVsOut* o,
 		o[i]=vertex_shader(b[i]);
 	}
 }
+
+//How each component of a vertex attribute is stored in its buffer
+enum class ComponentFormat: uint8_t
+{
+	FLOAT32,
+	FLOAT16,	//IEEE half precision
+	SNORM16,	//int16_t mapped to [-1,1]
+	UNORM8	//uint8_t mapped to [0,1]
+};
+inline std::size_t component_size(ComponentFormat f)
+{
+	return f==ComponentFormat::FLOAT32 ? 4 : (f==ComponentFormat::UNORM8 ? 1 : 2);
+}
+inline float half_to_float(uint16_t h)
+{
+	uint32_t sign=static_cast<uint32_t>(h & 0x8000) << 16;
+	uint32_t exponent=(h >> 10) & 0x1F;
+	uint32_t mantissa=h & 0x3FF;
+	uint32_t bits;
+	if(exponent==0)
+	{
+		//zero or subnormal
+		float f=std::ldexp(static_cast<float>(mantissa),-24);
+		return sign ? -f : f;
+	}
+	else if(exponent==31)
+	{
+		bits=sign | 0x7F800000 | (mantissa << 13);
+	}
+	else
+	{
+		bits=sign | ((exponent+112) << 23) | (mantissa << 13);
+	}
+	float f;
+	std::memcpy(&f,&bits,4);
+	return f;
+}
+inline uint16_t float_to_half(float f)
+{
+	uint32_t bits;
+	std::memcpy(&bits,&f,4);
+	uint16_t sign=(bits >> 16) & 0x8000;
+	int exponent=static_cast<int>((bits >> 23) & 0xFF)-112;
+	uint32_t mantissa=bits & 0x7FFFFF;
+	if(exponent >= 31)
+	{
+		//overflow goes to infinity, NaN stays NaN
+		return sign | 0x7C00 | (((bits >> 23) & 0xFF)==0xFF && mantissa ? 0x200 : 0);
+	}
+	if(exponent <= 0)
+	{
+		//subnormal or zero
+		if(exponent < -10) return sign;
+		mantissa|=0x800000;
+		return sign | static_cast<uint16_t>((mantissa+(1u << (13-exponent)))>>(14-exponent));
+	}
+	uint32_t h=(static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	h+=(mantissa >> 12) & 1;	//round, which can carry into the exponent correctly
+	return sign | static_cast<uint16_t>(h);
+}
+
+//This describes where one vertex attribute comes from, like glVertexAttribPointer: a pointer to the first vertex's value,
+//the number of bytes from one vertex to the next, and how many components of what format are stored there.
+struct VertexAttribute
+{
+	const uint8_t* pointer;
+	std::size_t stride;
+	unsigned int components;
+	ComponentFormat format;
+
+	VertexAttribute():
+		pointer(NULL),stride(0),components(0),format(ComponentFormat::FLOAT32)
+	{}
+	//stride defaults to tightly packed
+	VertexAttribute(const void* p,unsigned int c,ComponentFormat f=ComponentFormat::FLOAT32,std::size_t s=0):
+		pointer(static_cast<const uint8_t*>(p)),stride(s ? s : c*component_size(f)),components(c),format(f)
+	{}
+	//Decodes the attribute of vertex i.  Components that aren't stored are filled in from (0,0,0,1) like OpenGL does.
+	Eigen::Vector4f fetch(std::size_t i) const
+	{
+		Eigen::Vector4f v(0.0f,0.0f,0.0f,1.0f);
+		const uint8_t* p=pointer+i*stride;
+		for(unsigned int c=0;c<components;c++)
+		{
+			switch(format)
+			{
+			case ComponentFormat::FLOAT32:
+				std::memcpy(&v[c],p+4*c,4);
+				break;
+			case ComponentFormat::FLOAT16:
+			{
+				uint16_t h;
+				std::memcpy(&h,p+2*c,2);
+				v[c]=half_to_float(h);
+				break;
+			}
+			case ComponentFormat::SNORM16:
+			{
+				int16_t s;
+				std::memcpy(&s,p+2*c,2);
+				v[c]=std::max(s/32767.0f,-1.0f);
+				break;
+			}
+			case ComponentFormat::UNORM8:
+				v[c]=p[c]/255.0f;
+				break;
+			}
+		}
+		return v;
+	}
+};
+
+//The decoded attributes of one vertex, as the vertex shader sees them when drawing from a VertexArray.
+struct VertexInput
+{
+	static const unsigned int MAX_ATTRIBUTES=8;
+	std::size_t index;	//which vertex this is
+	std::array<Eigen::Vector4f,MAX_ATTRIBUTES> attributes;
+
+	const Eigen::Vector4f& operator[](unsigned int a) const
+	{
+		return attributes[a];
+	}
+};
+
+//This is a set of vertex attribute streams, like an OpenGL vertex array object.  The attributes can be interleaved in one buffer or
+//each in its own buffer, and stored in compact formats.  They are decoded as the vertex shader runs, so the application's buffers
+//are read in place instead of being copied into an array of vertex structs first.
+class VertexArray
+{
+public:
+	std::size_t num_vertices;
+	unsigned int num_attributes;
+	std::array<VertexAttribute,VertexInput::MAX_ATTRIBUTES> attributes;
+
+	explicit VertexArray(std::size_t n):
+		num_vertices(n),num_attributes(0)
+	{}
+	//Sets attribute slot a, which the vertex shader reads as input[a].  Throws std::out_of_range if a isn't less than MAX_ATTRIBUTES.
+	VertexArray& attribute(unsigned int a,const VertexAttribute& va)
+	{
+		if(a >= VertexInput::MAX_ATTRIBUTES)
+		{
+			throw std::out_of_range("uraster::VertexArray::attribute: attribute slot out of range");
+		}
+		attributes[a]=va;
+		num_attributes=std::max(num_attributes,a+1);
+		return *this;
+	}
+	VertexArray& attribute(unsigned int a,const void* p,unsigned int components,ComponentFormat f=ComponentFormat::FLOAT32,std::size_t stride=0)
+	{
+		return attribute(a,VertexAttribute(p,components,f,stride));
+	}
+	void fetch(std::size_t i,VertexInput& vi) const
+	{
+		vi.index=i;
+		for(unsigned int a=0;a<num_attributes;a++)
+		{
+			vi.attributes[a]=attributes[a].fetch(i);
+		}
+	}
+};
+
+//This runs the vertex shader on vertices assembled from a VertexArray.  The vertex shader takes a const VertexInput&.
+template<class VertexVsOut,class VertShader>
+void run_vertex_shader(const VertexArray& va,VertexVsOut* o,VertShader vertex_shader)
+{
+	#pragma omp parallel for
+	for(std::size_t i=0;i<va.num_vertices;i++)
+	{
+		VertexInput vi;
+		va.fetch(i,vi);
+		o[i]=vertex_shader(vi);
+	}
+}
+
 struct BarycentricTransform
 {
 private:
@@ -78,108 +627,1980 @@ public:
 		return Eigen::Vector3f(b[0],b[1],1.0f-b[0]-b[1]);
 	}
 };
-//This function takes in 3 varyings vertices from the fragment shader that make up a triangle,
-//rasterizes the triangle and runs the fragment shader on each resulting pixel.
-template<class PixelOut,class VertexVsOut,class FragShader>
-void rasterize_triangle(Framebuffer<PixelOut>& fb,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+//The viewport maps normalized device coordinates to pixels: x from -1 to 1 covers the columns [x,x+width) and y from -1 to 1 covers
+//the rows [y,y+height).  A negative height flips the image vertically, like in Vulkan.  Depth is mapped from [-1,1] to [min_depth,max_depth].
+//The default viewport of a framebuffer is (0,0,width,height) with the depth range [-1,1], which leaves depth alone.
+struct Viewport
 {
-	std::array<Eigen::Vector4f,3> points{{verts[0].position(),verts[1].position(),verts[2].position()}};
-	//Do the perspective divide by w to get screen space coordinates.
-	std::array<Eigen::Vector4f,3> epoints{{points[0]/points[0][3],points[1]/points[1][3],points[2]/points[2][3]}};
-	auto ss1=epoints[0].head<2>().array(),ss2=epoints[1].head<2>().array(),ss3=epoints[2].head<2>().array();
+	float x;
+	float y;
+	float width;
+	float height;
+	float min_depth;
+	float max_depth;
+
+	Viewport(float vx,float vy,float w,float h,float mind=-1.0f,float maxd=1.0f):
+		x(vx),y(vy),width(w),height(h),min_depth(mind),max_depth(maxd)
+	{}
+	Eigen::Array2f origin() const
+	{
+		return Eigen::Array2f(x,y);
+	}
+	Eigen::Array2f size() const
+	{
+		return Eigen::Array2f(width,height);
+	}
+	//The pixels [ul,lr) the viewport covers
+	void rect(Eigen::Array2i& ul,Eigen::Array2i& lr) const
+	{
+		Eigen::Array2f a=origin(),b=origin()+size();
+		ul=a.min(b).floor().cast<int>();
+		lr=a.max(b).ceil().cast<int>();
+	}
+};
 
-	//calculate the bounding box of the triangle in screen space floating point.
-	Eigen::Array2f bb_ul=ss1.min(ss2).min(ss3);
-	Eigen::Array2f bb_lr=ss1.max(ss2).max(ss3);
-	Eigen::Array2i isz(fb.width,fb.height);	
+//This is the per-triangle setup shared by the rasterizers: the perspective divide, the bounding box of the triangle in pixels
+//clamped to the framebuffer, and the transform from normalized device coordinates to barycentric coordinates.
+struct TriangleSetup
+{
+	std::array<Eigen::Vector4f,3> epoints;
+	Eigen::Array2i isz;
+	Eigen::Array2f vp_origin;
+	Eigen::Array2f vp_size;
+	float depth_scale;
+	float depth_offset;
+	Eigen::Array2i ibb_ul;
+	Eigen::Array2i ibb_lr;
+	BarycentricTransform bt;
 
-	//convert bounding box to fixed point.
-	//move bounding box from (-1.0,1.0)->(0,imgdim)
-	Eigen::Array2i ibb_ul=((bb_ul*0.5f+0.5f)*isz.cast<float>()).cast<int>();	
-	Eigen::Array2i ibb_lr=((bb_lr*0.5f+0.5f)*isz.cast<float>()).cast<int>();
-	ibb_lr+=1;	//add one pixel of coverage
+	template<class VertexVsOut>
+	TriangleSetup(const std::array<VertexVsOut,3>& verts,std::size_t width,std::size_t height):
+		TriangleSetup(verts,Viewport(0.0f,0.0f,width,height),width,height)
+	{}
+	//The setup for drawing to the viewport vp of a framebuffer of size width x height.  The bounding box is only clamped to the framebuffer.
+	template<class VertexVsOut>
+	TriangleSetup(const std::array<VertexVsOut,3>& verts,const Viewport& vp,std::size_t width,std::size_t height):
+		epoints(divide(verts)),
+		isz(width,height),
+		vp_origin(vp.origin()),vp_size(vp.size()),
+		depth_scale((vp.max_depth-vp.min_depth)*0.5f),depth_offset((vp.max_depth+vp.min_depth)*0.5f),
+		bt(epoints[0].head<2>(),epoints[1].head<2>(),epoints[2].head<2>())
+	{
+		bounds(epoints,vp,isz,ibb_ul,ibb_lr);
+	}
+	//Computes the pixel bounding box [ul,lr) of a perspective divided triangle in an image of size isz
+	static void bounds(const std::array<Eigen::Vector4f,3>& epoints,const Eigen::Array2i& isz,Eigen::Array2i& ibb_ul,Eigen::Array2i& ibb_lr)
+	{
+		bounds(epoints,Viewport(0.0f,0.0f,isz[0],isz[1]),isz,ibb_ul,ibb_lr);
+	}
+	//The same for a viewport of the image
+	static void bounds(const std::array<Eigen::Vector4f,3>& epoints,const Viewport& vp,const Eigen::Array2i& isz,Eigen::Array2i& ibb_ul,Eigen::Array2i& ibb_lr)
+	{
+		auto ss1=epoints[0].head<2>().array(),ss2=epoints[1].head<2>().array(),ss3=epoints[2].head<2>().array();
 
-	//clamp the bounding box to the framebuffer size if necessary (this is clipping.  Not quite how the GPU actually does it but same effect sorta).
-	ibb_ul=ibb_ul.max(Eigen::Array2i(0,0));
-	ibb_lr=ibb_lr.min(isz);
-	
+		//calculate the bounding box of the triangle in screen space floating point.
+		Eigen::Array2f bb_ul=ss1.min(ss2).min(ss3);
+		Eigen::Array2f bb_lr=ss1.max(ss2).max(ss3);
 
-	BarycentricTransform bt(ss1.matrix(),ss2.matrix(),ss3.matrix());
+		//convert bounding box to fixed point.
+		//move bounding box from (-1.0,1.0)->(viewport origin,viewport origin+viewport size), which swaps the corners of a flipped viewport
+		Eigen::Array2f p_ul=(bb_ul*0.5f+0.5f)*vp.size()+vp.origin();
+		Eigen::Array2f p_lr=(bb_lr*0.5f+0.5f)*vp.size()+vp.origin();
+		ibb_ul=p_ul.min(p_lr).cast<int>();
+		ibb_lr=p_ul.max(p_lr).cast<int>();
+		ibb_lr+=1;	//add one pixel of coverage
 
-	//for all the pixels in the bounding box
-	for(int y=ibb_ul[1];y<ibb_lr[1];y++)
-	for(int x=ibb_ul[0];x<ibb_lr[0];x++)
+		//clamp the bounding box to the framebuffer size if necessary (this is clipping.  Not quite how the GPU actually does it but same effect sorta).
+		ibb_ul=ibb_ul.max(Eigen::Array2i(0,0));
+		ibb_lr=ibb_lr.min(isz);
+	}
+	//Grows the bounding box by p pixels to the bottom right, for targets that sample past the pixel position
+	void pad(int p)
+	{
+		ibb_lr=(ibb_lr+p).min(isz);
+	}
+	//Restricts rasterization to the pixels in [ul,lr), for rendering one tile or band of the image at a time
+	void clip(const Eigen::Array2i& ul,const Eigen::Array2i& lr)
+	{
+		ibb_ul=ibb_ul.max(ul);
+		ibb_lr=ibb_lr.min(lr);
+	}
+	//Do the perspective divide by w to get screen space coordinates.
+	template<class VertexVsOut>
+	static std::array<Eigen::Vector4f,3> divide(const std::array<VertexVsOut,3>& verts)
+	{
+		std::array<Eigen::Vector4f,3> points{{verts[0].position(),verts[1].position(),verts[2].position()}};
+		return std::array<Eigen::Vector4f,3>{{points[0]/points[0][3],points[1]/points[1][3],points[2]/points[2][3]}};
+	}
+	//Barycentric coordinates of a point in pixel coordinates
+	Eigen::Vector3f barycentric(float x,float y) const
 	{
 		Eigen::Vector2f ssc(x,y);
-		ssc.array()/=isz.cast<float>();	//move pixel to relative coordinates
+		ssc.array()=(ssc.array()-vp_origin)/vp_size;	//move pixel to relative coordinates in the viewport
 		ssc.array()-=0.5f;
 		ssc.array()*=2.0f;
-
-		//Compute barycentric coordinates of the pixel center
-		Eigen::Vector3f bary=bt(ssc);
-		
-		//if the pixel has valid barycentric coordinates, the pixel is in the triangle
-		if((bary.array() < 1.0f).all() && (bary.array() > 0.0f).all())
+		return bt(ssc);
+	}
+	//if the pixel has valid barycentric coordinates, the pixel is in the triangle
+	static bool inside(const Eigen::Vector3f& bary)
+	{
+		return (bary.array() < 1.0f).all() && (bary.array() > 0.0f).all();
+	}
+	//Sets d to the depth of a point mapped to the viewport's depth range.  Returns false if the point is clipped, which is tested on the
+	//normalized device depth before the mapping, so it works the same for any depth range.
+	bool depth(const Eigen::Vector3f& bary,float& d) const
+	{
+		float z=bary[0]*epoints[0][2]+bary[1]*epoints[1][2]+bary[2]*epoints[2][2];
+		d=z*depth_scale+depth_offset;
+		return z < 1.0f;
+	}
+};
+
+//interpolate varying parameters
+template<class VertexVsOut>
+VertexVsOut interpolate(const std::array<VertexVsOut,3>& verts,const Eigen::Vector3f& bary)
+{
+	VertexVsOut v=verts[0];
+	v*=bary[0];
+	VertexVsOut vt=verts[1];
+	vt*=bary[1];
+	v+=vt;
+	vt=verts[2];
+	vt*=bary[2];
+	v+=vt;
+	return v;
+}
+
+//A vertex as one view of a multi-view draw sees it: the varyings shared by every view and that view's own clip position.
+//Only the shared varyings are interpolated, so the fragment shader gets an ordinary VertexVsOut.
+template<class VertexVsOut>
+struct ViewVertex
+{
+	const VertexVsOut* vertex;
+	Eigen::Vector4f p;
+
+	const Eigen::Vector4f& position() const
+	{
+		return p;
+	}
+};
+template<class VertexVsOut>
+VertexVsOut interpolate(const std::array<ViewVertex<VertexVsOut>,3>& verts,const Eigen::Vector3f& bary)
+{
+	VertexVsOut v=*verts[0].vertex;
+	v*=bary[0];
+	VertexVsOut vt=*verts[1].vertex;
+	vt*=bary[1];
+	v+=vt;
+	vt=*verts[2].vertex;
+	vt*=bary[2];
+	v+=vt;
+	return v;
+}
+
+//A vertex whose number of varyings is only known at runtime, but is the same for every vertex of a draw.
+//The varyings aren't owned: they point at num_varyings contiguous values that must outlive the draw, such as the vertex's own
+//attributes in the vertex buffer or a row of a num_vertices x num_varyings buffer filled by the vertex shader.
+//Interpolating these writes into a per-thread scratch buffer instead of allocating, so the VaryingVertex the fragment shader gets
+//points into that scratch and is only valid until the fragment shader returns.
+template<class T>
+struct VaryingVertex
+{
+	Eigen::Vector4f p;
+	const T* varyings;
+	std::size_t num_varyings;
+
+	VaryingVertex(const Eigen::Vector4f& tp=Eigen::Vector4f::Zero(),const T* tv=NULL,std::size_t k=0):
+		p(tp),varyings(tv),num_varyings(k)
+	{}
+	const Eigen::Vector4f& position() const
+	{
+		return p;
+	}
+	const T& operator[](std::size_t i) const
+	{
+		return varyings[i];
+	}
+	Eigen::Map<const Eigen::Array<T,Eigen::Dynamic,1>> array() const
+	{
+		return Eigen::Map<const Eigen::Array<T,Eigen::Dynamic,1>>(varyings,num_varyings);
+	}
+};
+namespace detail
+{
+template<class T>
+VaryingVertex<T> interpolate_varyings(const VaryingVertex<T>& v0,const VaryingVertex<T>& v1,const VaryingVertex<T>& v2,const Eigen::Vector4f& p,const Eigen::Vector3f& bary)
+{
+	static thread_local std::vector<T> scratch;
+	std::size_t k=v0.num_varyings;
+	if(scratch.size() < k)
+	{
+		scratch.resize(k);
+	}
+	//one pass over the k lanes, which Eigen vectorizes
+	Eigen::Map<Eigen::Array<T,Eigen::Dynamic,1>>(scratch.data(),k)=v0.array()*bary[0]+v1.array()*bary[1]+v2.array()*bary[2];
+	return VaryingVertex<T>(p,scratch.data(),k);
+}
+}
+template<class T>
+VaryingVertex<T> interpolate(const std::array<VaryingVertex<T>,3>& verts,const Eigen::Vector3f& bary)
+{
+	Eigen::Vector4f p=verts[0].p*bary[0]+verts[1].p*bary[1]+verts[2].p*bary[2];
+	return detail::interpolate_varyings(verts[0],verts[1],verts[2],p,bary);
+}
+template<class T>
+VaryingVertex<T> interpolate(const std::array<ViewVertex<VaryingVertex<T>>,3>& verts,const Eigen::Vector3f& bary)
+{
+	const VaryingVertex<T>& v0=*verts[0].vertex;
+	const VaryingVertex<T>& v1=*verts[1].vertex;
+	const VaryingVertex<T>& v2=*verts[2].vertex;
+	Eigen::Vector4f p=v0.p*bary[0]+v1.p*bary[1]+v2.p*bary[2];
+	return detail::interpolate_varyings(v0,v1,v2,p,bary);
+}
+
+//Blend equations.  A blend is called as blend(PixelOut& dst,const PixelOut& src) and combines the fragment shader's output src into the
+//pixel dst that is already there.  These work on pixels with an rgba() method returning a reference to an Eigen::Vector4f, but any
+//functor with that signature can be used for other pixel types.
+
+//src over dst with straight (not premultiplied) alpha
+struct BlendOver
+{
+	template<class PixelOut>
+	void operator()(PixelOut& dst,PixelOut src) const
+	{
+		Eigen::Vector4f& d=dst.rgba();
+		const Eigen::Vector4f& sc=src.rgba();
+		float a=sc[3];
+		d.head<3>()=sc.head<3>()*a+d.head<3>()*(1.0f-a);
+		d[3]=a+d[3]*(1.0f-a);
+	}
+};
+//src over dst where the colors are already multiplied by their alpha
+struct BlendPremultiplied
+{
+	template<class PixelOut>
+	void operator()(PixelOut& dst,PixelOut src) const
+	{
+		const Eigen::Vector4f& sc=src.rgba();
+		dst.rgba()=sc+dst.rgba()*(1.0f-sc[3]);
+	}
+};
+struct BlendAdd
+{
+	template<class PixelOut>
+	void operator()(PixelOut& dst,PixelOut src) const
+	{
+		dst.rgba()+=src.rgba();
+	}
+};
+struct BlendMin
+{
+	template<class PixelOut>
+	void operator()(PixelOut& dst,PixelOut src) const
+	{
+		dst.rgba()=dst.rgba().cwiseMin(src.rgba());
+	}
+};
+struct BlendMax
+{
+	template<class PixelOut>
+	void operator()(PixelOut& dst,PixelOut src) const
+	{
+		dst.rgba()=dst.rgba().cwiseMax(src.rgba());
+	}
+};
+
+//A fragment shader whose output is blended into the target instead of replacing it.  Fragments are still depth tested, but they don't
+//write depth, as usual for translucent surfaces.  Make one with blended(fragment_shader,blend) and pass it anywhere a fragment shader goes.
+//Blending depends on the order fragments arrive in, so rasterize always draws blended triangles tile by tile in submission order
+//like RasterMode::DETERMINISTIC.  Whether a shader blends is known at compile time, so ordinary shaders pay nothing for this.
+template<class FragShader>
+struct StencilShader;
+namespace detail
+{
+template<class FragShader>
+struct is_stencil_shader: public std::false_type
+{};
+template<class FragShader>
+struct is_stencil_shader<StencilShader<FragShader> >: public std::true_type
+{};
+}
+template<class FragShader,class Blend>
+struct BlendedShader
+{
+	//the rasterizers only look at the outermost wrapper, so a stencil test inside would never run
+	static_assert(!detail::is_stencil_shader<FragShader>::value,"put the stencil test outside the blend: stencil_test(blended(fs,blend),state)");
+
+	FragShader shader;
+	Blend blend;
+
+	template<class VertexVsOut>
+	auto operator()(const VertexVsOut& v) -> decltype(shader(v))
+	{
+		return shader(v);
+	}
+};
+template<class FragShader,class Blend>
+BlendedShader<FragShader,Blend> blended(FragShader fragment_shader,Blend blend)
+{
+	BlendedShader<FragShader,Blend> bs={fragment_shader,blend};
+	return bs;
+}
+
+//Comparison functions for the stencil test, which passes when (ref & read_mask) func (stencil & read_mask) like OpenGL
+enum class CompareFunc: uint8_t
+{
+	NEVER,
+	LESS,
+	EQUAL,
+	LESS_EQUAL,
+	GREATER,
+	NOT_EQUAL,
+	GREATER_EQUAL,
+	ALWAYS
+};
+//What happens to the stencil value of a pixel after the stencil and depth tests
+enum class StencilOp: uint8_t
+{
+	KEEP,
+	ZERO,
+	REPLACE,	//with ref
+	INCR,	//clamped to 255
+	INCR_WRAP,
+	DECR,	//clamped to 0
+	DECR_WRAP,
+	INVERT
+};
+//The stencil test and the ops applied when it fails, when it passes but the depth test fails, and when both pass.
+//Only the bits in write_mask are changed.  With write_pixel false the fragment shader never runs and only the stencil is written,
+//which is how masks for portals and decals are drawn.
+struct StencilState
+{
+	CompareFunc func;
+	uint8_t ref;
+	uint8_t read_mask;
+	uint8_t write_mask;
+	StencilOp fail;
+	StencilOp depth_fail;
+	StencilOp pass;
+	bool write_pixel;
+
+	StencilState(CompareFunc f=CompareFunc::ALWAYS,uint8_t r=0,
+		StencilOp sfail=StencilOp::KEEP,StencilOp dpfail=StencilOp::KEEP,StencilOp dppass=StencilOp::KEEP,
+		bool wp=true,uint8_t rmask=0xFF,uint8_t wmask=0xFF):
+		func(f),ref(r),read_mask(rmask),write_mask(wmask),
+		fail(sfail),depth_fail(dpfail),pass(dppass),
+		write_pixel(wp)
+	{}
+	bool compare(uint8_t stencil) const
+	{
+		uint8_t a=ref & read_mask,b=stencil & read_mask;
+		switch(func)
+		{
+		case CompareFunc::NEVER:		return false;
+		case CompareFunc::LESS:			return a < b;
+		case CompareFunc::EQUAL:		return a == b;
+		case CompareFunc::LESS_EQUAL:		return a <= b;
+		case CompareFunc::GREATER:		return a > b;
+		case CompareFunc::NOT_EQUAL:		return a != b;
+		case CompareFunc::GREATER_EQUAL:	return a >= b;
+		default:				return true;
+		}
+	}
+	void apply(StencilOp op,uint8_t& stencil) const
+	{
+		uint8_t v=stencil;
+		switch(op)
+		{
+		case StencilOp::KEEP:		return;
+		case StencilOp::ZERO:		v=0;break;
+		case StencilOp::REPLACE:	v=ref;break;
+		case StencilOp::INCR:		v=v==255 ? 255 : v+1;break;
+		case StencilOp::INCR_WRAP:	v++;break;
+		case StencilOp::DECR:		v=v==0 ? 0 : v-1;break;
+		case StencilOp::DECR_WRAP:	v--;break;
+		case StencilOp::INVERT:		v=~v;break;
+		}
+		stencil=(stencil & ~write_mask) | (v & write_mask);
+	}
+	//Runs the stencil test on a pixel whose depth test result is depth_pass and updates its stencil.  True if the fragment survives both tests.
+	bool test(uint8_t& stencil,bool depth_pass) const
+	{
+		if(!compare(stencil))
+		{
+			apply(fail,stencil);
+			return false;
+		}
+		apply(depth_pass ? pass : depth_fail,stencil);
+		return depth_pass;
+	}
+};
+
+//A fragment shader with a stencil test in front of it.  Make one with stencil_test(fragment_shader,state) and pass it anywhere a fragment
+//shader goes, including wrapped around a blended() one (but not inside one).  The pixel type needs a uint8_t& stencil() method next to depth().
+//The test runs before the varyings are interpolated, so masked out pixels cost about as much as pixels that fail the depth test.
+//The stencil ops read and write the target, so rasterize always draws these tile by tile in submission order, like blended shaders.
+template<class FragShader>
+struct StencilShader
+{
+	FragShader shader;
+	StencilState state;
+
+	template<class VertexVsOut>
+	auto operator()(const VertexVsOut& v) -> decltype(shader(v))
+	{
+		return shader(v);
+	}
+};
+template<class FragShader>
+StencilShader<FragShader> stencil_test(FragShader fragment_shader,const StencilState& state)
+{
+	StencilShader<FragShader> ss={fragment_shader,state};
+	return ss;
+}
+
+namespace detail
+{
+//Shaders whose result depends on the order fragments arrive in
+template<class FragShader>
+struct is_blended: public std::false_type
+{};
+template<class FragShader,class Blend>
+struct is_blended<BlendedShader<FragShader,Blend> >: public std::true_type
+{};
+template<class FragShader>
+struct is_blended<StencilShader<FragShader> >: public std::true_type
+{};
+//Targets that need each pixel to be written by only one thread at a time, which rasterize always bins for
+template<class Target>
+struct is_ordered_target: public std::false_type
+{};
+
+//The tests a fragment at depth d has to pass before the fragment shader runs for pixel po
+template<class PixelOut,class FragShader>
+bool test_fragment(PixelOut& po,float d,FragShader&)
+{
+	return po.depth() < d;
+}
+template<class PixelOut,class FragShader>
+bool test_fragment(PixelOut& po,float d,StencilShader<FragShader>& ss)
+{
+	return ss.state.test(po.stencil(),test_fragment(po,d,ss.shader)) && ss.state.write_pixel;
+}
+
+//Copies a fragment to a pixel.  The stencil value belongs to the target, so pixels with a stencil() keep theirs.
+template<class PixelOut>
+auto assign_fragment(PixelOut& dst,const PixelOut& src,int) -> decltype(dst.stencil(),void())
+{
+	uint8_t stencil=dst.stencil();
+	dst=src;
+	dst.stencil()=stencil;
+}
+template<class PixelOut>
+void assign_fragment(PixelOut& dst,const PixelOut& src,long)
+{
+	dst=src;
+}
+//Writes the fragment shader output src to the pixel dst, which passed the depth test at depth d
+template<class PixelOut,class FragShader>
+void write_fragment(PixelOut& dst,const PixelOut& src,float d,FragShader&)
+{
+	assign_fragment(dst,src,0);
+	dst.depth()=d;
+}
+template<class PixelOut,class FragShader,class Blend>
+void write_fragment(PixelOut& dst,const PixelOut& src,float,BlendedShader<FragShader,Blend>& bs)
+{
+	bs.blend(dst,src);
+}
+template<class PixelOut,class FragShader>
+void write_fragment(PixelOut& dst,const PixelOut& src,float d,StencilShader<FragShader>& ss)
+{
+	write_fragment(dst,src,d,ss.shader);
+}
+
+//This is the single sample rasterizer behind the Framebuffer and FramebufferView overloads below.
+//Fb is any framebuffer whose (x,y) accessor returns a PixelOut& that has a depth() method.
+template<class PixelOut,class Fb,class VertexVsOut,class FragShader>
+void rasterize_triangle_pixels(Fb& fb,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	//for all the pixels in the bounding box
+	for(int y=ts.ibb_ul[1];y<ts.ibb_lr[1];y++)
+	for(int x=ts.ibb_ul[0];x<ts.ibb_lr[0];x++)
+	{
+		//Compute barycentric coordinates of the pixel center
+		Eigen::Vector3f bary=ts.barycentric(x,y);
+		
+		if(TriangleSetup::inside(bary))
+		{
+			float d;
+			//Reference the current pixel at that coordinate
+			PixelOut& po=fb(x,y);
+			// if the fragment isn't clipped and the interpolated depth passes the depth test (and the stencil test, if there is one)
+			if(ts.depth(bary,d) && test_fragment(po,d,fragment_shader))
+			{
+				//call the fragment shader and write the result and the depth buffer
+				write_fragment(po,fragment_shader(interpolate(verts,bary)),d,fragment_shader);
+			}
+		}
+	}
+}
+}
+
+//How many pixels past the bottom right of a triangle's bounding box a target can be covered.  The multisample overload is below.
+template<class Target>
+int bounds_padding(const Target&)
+{
+	return 0;
+}
+//The triangle setup for drawing to a target, which is the one the rasterize_triangle overloads taking a TriangleSetup expect.
+//Binning should use its bounding box, so a triangle is binned to every tile it can write to.
+template<class Target,class VertexVsOut>
+TriangleSetup triangle_setup(const Target& fb,const std::array<VertexVsOut,3>& verts)
+{
+	TriangleSetup ts(verts,fb.width,fb.height);
+	ts.pad(bounds_padding(fb));
+	return ts;
+}
+//Just the bounding box [ul,lr) of triangle_setup(fb,verts), for binning
+template<class Target,class VertexVsOut>
+void triangle_bounds(const Target& fb,const std::array<VertexVsOut,3>& verts,Eigen::Array2i& ul,Eigen::Array2i& lr)
+{
+	Eigen::Array2i isz(fb.width,fb.height);
+	TriangleSetup::bounds(TriangleSetup::divide(verts),isz,ul,lr);
+	lr=(lr+bounds_padding(fb)).min(isz);
+}
+
+//This function takes in 3 varyings vertices from the fragment shader that make up a triangle,
+//rasterizes the triangle and runs the fragment shader on each resulting pixel.
+//Each target has two overloads: one that does the whole triangle, and one that only does the pixels in the bounding box of a
+//TriangleSetup from triangle_setup, which can be clipped to a tile first.
+template<class PixelOut,class Layout,class VertexVsOut,class FragShader>
+void rasterize_triangle(Framebuffer<PixelOut,Layout>& fb,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	detail::rasterize_triangle_pixels<PixelOut>(fb,ts,verts,fragment_shader);
+}
+template<class PixelOut,class Layout,class VertexVsOut,class FragShader>
+void rasterize_triangle(Framebuffer<PixelOut,Layout>& fb,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	detail::rasterize_triangle_pixels<PixelOut>(fb,TriangleSetup(verts,fb.width,fb.height),verts,fragment_shader);
+}
+template<class PixelOut,class VertexVsOut,class FragShader>
+void rasterize_triangle(FramebufferView<PixelOut>& fb,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	detail::rasterize_triangle_pixels<PixelOut>(fb,ts,verts,fragment_shader);
+}
+template<class PixelOut,class VertexVsOut,class FragShader>
+void rasterize_triangle(FramebufferView<PixelOut>& fb,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	detail::rasterize_triangle_pixels<PixelOut>(fb,TriangleSetup(verts,fb.width,fb.height),verts,fragment_shader);
+}
+
+template<class PixelOut,unsigned int TileSize,class VertexVsOut,class FragShader>
+void rasterize_triangle(SparseFramebuffer<PixelOut,TileSize>& fb,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	detail::rasterize_triangle_pixels<PixelOut>(fb,ts,verts,fragment_shader);
+}
+template<class PixelOut,unsigned int TileSize,class VertexVsOut,class FragShader>
+void rasterize_triangle(SparseFramebuffer<PixelOut,TileSize>& fb,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	detail::rasterize_triangle_pixels<PixelOut>(fb,TriangleSetup(verts,fb.width,fb.height),verts,fragment_shader);
+}
+
+//samples can sit up to half a pixel before the pixel's position, so the pixel just past the bottom right of the box can still be covered.
+template<class PixelOut,unsigned int Samples>
+int bounds_padding(const MultisampleFramebuffer<PixelOut,Samples>&)
+{
+	return 1;
+}
+//This is the multisample version.  Coverage and depth are tested at every sample in the pixel, but the fragment shader
+//runs once per pixel and its output is copied to each covered sample with that sample's own depth.
+template<class PixelOut,unsigned int Samples,class VertexVsOut,class FragShader>
+void rasterize_triangle(MultisampleFramebuffer<PixelOut,Samples>& fb,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	typedef MultisampleFramebuffer<PixelOut,Samples> Fb;
+
+	for(int y=ts.ibb_ul[1];y<ts.ibb_lr[1];y++)
+	for(int x=ts.ibb_ul[0];x<ts.ibb_lr[0];x++)
+	{
+		std::array<float,Samples> d;
+		unsigned int mask=0;
+		unsigned int first=Samples;
+		Eigen::Vector3f sbary=Eigen::Vector3f::Zero();
+		for(unsigned int s=0;s<Samples;s++)
+		{
+			Eigen::Vector3f bary=ts.barycentric(x+Fb::offset(s,0),y+Fb::offset(s,1));
+			if(TriangleSetup::inside(bary))
+			{
+				if(ts.depth(bary,d[s]) && detail::test_fragment(fb(x,y,s),d[s],fragment_shader))
+				{
+					mask|=1u << s;
+					if(first==Samples)
+					{
+						first=s;
+						sbary=bary;
+					}
+				}
+			}
+		}
+		if(mask)
+		{
+			//shade at the pixel position when it is inside the triangle, otherwise at the first covered sample so the varyings are never extrapolated
+			Eigen::Vector3f bary=ts.barycentric(x,y);
+			if(!TriangleSetup::inside(bary))
+			{
+				bary=sbary;
+			}
+			PixelOut po=fragment_shader(interpolate(verts,bary));
+			for(unsigned int s=first;s<Samples;s++)
+			{
+				if(mask & (1u << s))
+				{
+					detail::write_fragment(fb(x,y,s),po,d[s],fragment_shader);
+				}
+			}
+		}
+	}
+}
+template<class PixelOut,unsigned int Samples,class VertexVsOut,class FragShader>
+void rasterize_triangle(MultisampleFramebuffer<PixelOut,Samples>& fb,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	rasterize_triangle(fb,triangle_setup(fb,verts),verts,fragment_shader);
+}
+
+
+//This is the multiple render target version.  The depth test reads only the depth buffer, and every color buffer is written from one fragment shader call.
+template<class DepthBuffer,class... ColorBuffers,class VertexVsOut,class FragShader>
+void rasterize_triangle(RenderTargets<DepthBuffer,ColorBuffers...>& rt,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	static_assert(!detail::is_blended<FragShader>::value,"blending and stencil tests aren't supported with multiple render targets");
+	for(int y=ts.ibb_ul[1];y<ts.ibb_lr[1];y++)
+	for(int x=ts.ibb_ul[0];x<ts.ibb_lr[0];x++)
+	{
+		Eigen::Vector3f bary=ts.barycentric(x,y);
+		if(TriangleSetup::inside(bary))
+		{
+			float d;
+			auto& pd=rt.depth(x,y);
+			if(ts.depth(bary,d) && pd < d)
+			{
+				rt.write(x,y,fragment_shader(interpolate(verts,bary)));
+				pd=d;
+			}
+		}
+	}
+}
+template<class DepthBuffer,class... ColorBuffers,class VertexVsOut,class FragShader>
+void rasterize_triangle(RenderTargets<DepthBuffer,ColorBuffers...>& rt,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	rasterize_triangle(rt,TriangleSetup(verts,rt.width,rt.height),verts,fragment_shader);
+}
+
+//This is a framebuffer of k planes of T, one whole image per plane, in memory owned by someone else, plus its own depth plane.
+//Strides are in elements of T, so MATLAB's column-major rows x columns x k arrays are xstride=rows, ystride=1, plane_stride=rows*columns.
+//Pixels are written in place: instead of returning a pixel, the fragment shader is called as fragment_shader(const VertexVsOut& v,PlanarPixel& px)
+//and sets the k values with px[i].  Nothing is allocated per pixel and there is nothing to copy out afterwards.
+template<class T>
+class PlanarFramebuffer
+{
+protected:
+	T* planes;
+	std::ptrdiff_t xstride;
+	std::ptrdiff_t ystride;
+	std::ptrdiff_t plane_stride;
+	std::vector<float> depths;
+public:
+	const std::size_t width;
+	const std::size_t height;
+	const std::size_t num_planes;
+
+	//One pixel of all the planes
+	class PlanarPixel
+	{
+	protected:
+		T* base;
+		std::ptrdiff_t offset;
+		std::ptrdiff_t plane_stride;
+	public:
+		PlanarPixel(T* b,std::ptrdiff_t o,std::ptrdiff_t ps):
+			base(b),offset(o),plane_stride(ps)
+		{}
+		T& operator[](std::size_t i)
+		{
+			return base[offset+static_cast<std::ptrdiff_t>(i)*plane_stride];
+		}
+		//Where this pixel is in a plane, for writing other planes with the same layout like a coverage mask
+		std::ptrdiff_t index() const
+		{
+			return offset;
+		}
+	};
+
+	//ystride and plane_stride default to tightly packed row-major planes
+	PlanarFramebuffer(T* data,std::size_t w,std::size_t h,std::size_t k,
+		std::ptrdiff_t xs=1,std::ptrdiff_t ys=0,std::ptrdiff_t ps=0,float clear_depth=-1e10f):
+		planes(data),
+		xstride(xs),ystride(ys ? ys : xs*static_cast<std::ptrdiff_t>(w)),
+		plane_stride(ps ? ps : static_cast<std::ptrdiff_t>(w*h)),
+		depths(w*h,clear_depth),
+		width(w),height(h),num_planes(k)
+	{}
+	PlanarPixel operator()(std::size_t x,std::size_t y)
+	{
+		return PlanarPixel(planes,static_cast<std::ptrdiff_t>(x)*xstride+static_cast<std::ptrdiff_t>(y)*ystride,plane_stride);
+	}
+	float& depth(std::size_t x,std::size_t y)
+	{
+		return depths[y*width+x];
+	}
+	//Only clears depth, since the planes belong to the caller
+	void clear_depth(float d=-1e10f)
+	{
+		std::fill(depths.begin(),depths.end(),d);
+	}
+};
+
+template<class T,class VertexVsOut,class FragShader>
+void rasterize_triangle(PlanarFramebuffer<T>& fb,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	static_assert(!detail::is_blended<FragShader>::value,"blending and stencil tests aren't supported with planar framebuffers");
+	for(int y=ts.ibb_ul[1];y<ts.ibb_lr[1];y++)
+	for(int x=ts.ibb_ul[0];x<ts.ibb_lr[0];x++)
+	{
+		Eigen::Vector3f bary=ts.barycentric(x,y);
+		if(TriangleSetup::inside(bary))
+		{
+			float d;
+			float& pd=fb.depth(x,y);
+			if(ts.depth(bary,d) && pd < d)
+			{
+				typename PlanarFramebuffer<T>::PlanarPixel px=fb(x,y);
+				fragment_shader(interpolate(verts,bary),px);
+				pd=d;
+			}
+		}
+	}
+}
+template<class T,class VertexVsOut,class FragShader>
+void rasterize_triangle(PlanarFramebuffer<T>& fb,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	rasterize_triangle(fb,TriangleSetup(verts,fb.width,fb.height),verts,fragment_shader);
+}
+
+//This is a framebuffer for order independent transparency.  Opaque geometry is drawn into the ordinary Framebuffer opaque first.
+//Translucent geometry is then drawn into this, and every fragment that passes the depth test against opaque is appended to a list for
+//its pixel instead of being written, without writing depth.  resolve sorts each pixel's fragments and blends them back to front over
+//the opaque pixel, so translucent triangles can be drawn in any order.
+//The memory for the fragments is fixed by a budget in bytes.  Every pixel is guaranteed min_layers slots of its own (a k-buffer),
+//and the rest of the budget is one pool shared by the whole image, so a few pixels with deep overdraw can use far more layers than that.
+//When a pixel's slots are full and so is the pool, a new fragment replaces the farthest fragment in that pixel's list if it is nearer,
+//so every pixel always keeps the nearest of its fragments, at least min_layers of them, and only farther layers are dropped.
+//dropped() counts the fragments lost.  If the budget is less than min_layers fragments per pixel, min_layers is lowered to fit, but never
+//below one, so the budget is rounded up to one fragment per pixel.
+//rasterize always bins triangles for this target, so no two threads append to the same pixel at once.
+template<class PixelOut>
+class OITFramebuffer
+{
+public:
+	struct Fragment
+	{
+		PixelOut pixel;
+		float depth;
+		uint32_t next;
+	};
+	static const uint32_t NONE=0xFFFFFFFF;
+
+	Framebuffer<PixelOut> opaque;
+	const std::size_t width;
+	const std::size_t height;
+	const std::size_t min_layers;
+protected:
+	const std::size_t pool_size;
+	std::vector<uint32_t> heads;	//the first fragment of each pixel's list
+	std::vector<uint32_t> layers;	//how many of its own slots each pixel has used
+	//pixel i's own slots are [i*min_layers,(i+1)*min_layers), followed by the shared pool
+	std::unique_ptr<Fragment[]> arena;
+	std::atomic<std::size_t> pool_used;
+	std::atomic<std::size_t> num_dropped;
+
+	static std::size_t fit_layers(std::size_t w,std::size_t h,std::size_t budget_bytes,std::size_t k)
+	{
+		return std::max<std::size_t>(std::min(k,budget_bytes/sizeof(Fragment)/std::max<std::size_t>(w*h,1)),1);
+	}
+public:
+	//k is the number of layers every pixel is guaranteed
+	OITFramebuffer(std::size_t w,std::size_t h,std::size_t budget_bytes,const PixelOut& clear_pixel=PixelOut(),std::size_t k=4):
+		opaque(w,h,clear_pixel),
+		width(w),height(h),
+		min_layers(fit_layers(w,h,budget_bytes,k)),
+		pool_size(budget_bytes/sizeof(Fragment)-std::min(budget_bytes/sizeof(Fragment),w*h*min_layers)),
+		heads(w*h,NONE),
+		layers(w*h,0),
+		arena(new Fragment[w*h*min_layers+pool_size]),
+		pool_used(0),
+		num_dropped(0)
+	{}
+	//Forgets the translucent fragments but keeps the opaque image
+	void clear_fragments()
+	{
+		std::fill(heads.begin(),heads.end(),NONE);
+		std::fill(layers.begin(),layers.end(),0);
+		pool_used=0;
+		num_dropped=0;
+	}
+	void clear(const PixelOut& clear_pixel=PixelOut())
+	{
+		opaque.clear(clear_pixel);
+		clear_fragments();
+	}
+	//Adds a fragment at depth d to pixel (x,y).  Only one thread may add to a pixel at a time.
+	void add(std::size_t x,std::size_t y,const PixelOut& p,float d)
+	{
+		std::size_t pi=y*width+x;
+		uint32_t& head=heads[pi];
+		std::size_t slot;
+		if(layers[pi] < min_layers)
+		{
+			slot=pi*min_layers+layers[pi]++;
+		}
+		else
+		{
+			//once the pool is full the counter isn't touched again, so it can't wrap around
+			std::size_t n=pool_size;
+			if(pool_used.load(std::memory_order_relaxed) < pool_size)
+			{
+				n=pool_used++;
+			}
+			if(n >= pool_size)
+			{
+				num_dropped++;
+				//everything is full, so keep the nearer of this and the farthest fragment already in the list.  The list
+				//can't be empty here since the pixel's own slots are used first.
+				uint32_t farthest=head;
+				for(uint32_t i=head;i!=NONE;i=arena[i].next)
+				{
+					if(arena[i].depth < arena[farthest].depth)
+					{
+						farthest=i;
+					}
+				}
+				if(arena[farthest].depth < d)
+				{
+					arena[farthest].pixel=p;
+					arena[farthest].depth=d;
+				}
+				return;
+			}
+			slot=width*height*min_layers+n;
+		}
+		arena[slot].pixel=p;
+		arena[slot].depth=d;
+		arena[slot].next=head;
+		head=static_cast<uint32_t>(slot);
+	}
+	//The number of fragments that didn't fit in the budget since the last clear
+	std::size_t dropped() const
+	{
+		return num_dropped;
+	}
+	//Composites every pixel's fragments over the opaque image with blend (see BlendOver), farthest first, then clears the fragments.
+	//Fragments at the same depth are blended in the order they were drawn.  The result is in opaque.
+	template<class Blend>
+	void resolve(Blend blend)
+	{
+		#pragma omp parallel
+		{
+			std::vector<std::pair<float,uint32_t> > order;
+			#pragma omp for schedule(dynamic)
+			for(std::size_t y=0;y<height;y++)
+			{
+				for(std::size_t x=0;x<width;x++)
+				{
+					uint32_t head=heads[y*width+x];
+					if(head==NONE)
+					{
+						continue;
+					}
+					const Fragment* ta=arena.get();
+					//the list runs newest first, so reversing it puts equal depths in drawing order for the stable sort
+					order.clear();
+					for(uint32_t i=head;i!=NONE;i=ta[i].next)
+					{
+						order.push_back(std::make_pair(ta[i].depth,i));
+					}
+					std::reverse(order.begin(),order.end());
+					std::stable_sort(order.begin(),order.end(),
+						[](const std::pair<float,uint32_t>& a,const std::pair<float,uint32_t>& b) { return a.first < b.first; });
+					PixelOut& po=opaque(x,y);
+					for(std::size_t k=0;k<order.size();k++)
+					{
+						blend(po,ta[order[k].second].pixel);
+					}
+				}
+			}
+		}
+		clear_fragments();
+	}
+};
+//NONE is bound to references (by std::fill and the vector constructor), so it needs a definition
+template<class PixelOut>
+const uint32_t OITFramebuffer<PixelOut>::NONE;
+
+template<class PixelOut,class VertexVsOut,class FragShader>
+void rasterize_triangle(OITFramebuffer<PixelOut>& fb,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	for(int y=ts.ibb_ul[1];y<ts.ibb_lr[1];y++)
+	for(int x=ts.ibb_ul[0];x<ts.ibb_lr[0];x++)
+	{
+		Eigen::Vector3f bary=ts.barycentric(x,y);
+		if(TriangleSetup::inside(bary))
+		{
+			float d;
+			if(ts.depth(bary,d) && detail::test_fragment(fb.opaque(x,y),d,fragment_shader))
+			{
+				fb.add(x,y,fragment_shader(interpolate(verts,bary)),d);
+			}
+		}
+	}
+}
+template<class PixelOut,class VertexVsOut,class FragShader>
+void rasterize_triangle(OITFramebuffer<PixelOut>& fb,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	rasterize_triangle(fb,TriangleSetup(verts,fb.width,fb.height),verts,fragment_shader);
+}
+namespace detail
+{
+template<class PixelOut>
+struct is_ordered_target<OITFramebuffer<PixelOut> >: public std::true_type
+{};
+}
+
+//This draws into a viewport of another target, with the raster bounds also clamped to a scissor rectangle, so split screen views,
+//atlas entries or single tiles can be rendered into one shared framebuffer.  It only refers to the target, so it is cheap to make
+//one per draw with with_viewport.  Pixels outside both the viewport and the scissor rectangle are never touched.
+template<class Target>
+struct ViewportTarget
+{
+	Target& target;
+	Viewport viewport;
+	Eigen::Array2i scissor_ul;
+	Eigen::Array2i scissor_lr;
+	const std::size_t width;
+	const std::size_t height;
+
+	ViewportTarget(Target& t,const Viewport& vp,const Eigen::Array2i& sul,const Eigen::Array2i& slr):
+		target(t),viewport(vp),width(t.width),height(t.height)
+	{
+		Eigen::Array2i vul,vlr;
+		vp.rect(vul,vlr);
+		scissor_ul=sul.max(vul);
+		scissor_lr=slr.min(vlr);
+	}
+};
+//The scissor rectangle is the pixels [x,x+width) x [y,y+height)
+template<class Target>
+ViewportTarget<Target> with_viewport(Target& fb,const Viewport& vp,int sx,int sy,int swidth,int sheight)
+{
+	return ViewportTarget<Target>(fb,vp,Eigen::Array2i(sx,sy),Eigen::Array2i(sx+swidth,sy+sheight));
+}
+template<class Target>
+ViewportTarget<Target> with_viewport(Target& fb,const Viewport& vp)
+{
+	return ViewportTarget<Target>(fb,vp,Eigen::Array2i(0,0),Eigen::Array2i(fb.width,fb.height));
+}
+
+template<class Target>
+int bounds_padding(const ViewportTarget<Target>& vt)
+{
+	return bounds_padding(vt.target);
+}
+template<class Target,class VertexVsOut>
+TriangleSetup triangle_setup(const ViewportTarget<Target>& vt,const std::array<VertexVsOut,3>& verts)
+{
+	TriangleSetup ts(verts,vt.viewport,vt.width,vt.height);
+	ts.pad(bounds_padding(vt.target));
+	ts.clip(vt.scissor_ul,vt.scissor_lr);
+	return ts;
+}
+template<class Target,class VertexVsOut>
+void triangle_bounds(const ViewportTarget<Target>& vt,const std::array<VertexVsOut,3>& verts,Eigen::Array2i& ul,Eigen::Array2i& lr)
+{
+	Eigen::Array2i isz(vt.width,vt.height);
+	TriangleSetup::bounds(TriangleSetup::divide(verts),vt.viewport,isz,ul,lr);
+	ul=ul.max(vt.scissor_ul);
+	lr=(lr+bounds_padding(vt.target)).min(isz).min(vt.scissor_lr);
+}
+template<class Target,class VertexVsOut,class FragShader>
+void rasterize_triangle(ViewportTarget<Target>& vt,const TriangleSetup& ts,const std::array<VertexVsOut,3>& verts,FragShader& fragment_shader)
+{
+	rasterize_triangle(vt.target,ts,verts,fragment_shader);
+}
+template<class Target,class VertexVsOut,class FragShader>
+void rasterize_triangle(ViewportTarget<Target>& vt,const std::array<VertexVsOut,3>& verts,FragShader fragment_shader)
+{
+	rasterize_triangle(vt.target,triangle_setup(vt,verts),verts,fragment_shader);
+}
+namespace detail
+{
+template<class Target>
+struct is_ordered_target<ViewportTarget<Target> >: public is_ordered_target<Target>
+{};
+}
+
+//How an index buffer is read as triangles
+enum class Topology
+{
+	TRIANGLE_LIST,	//triangle k is (3k,3k+1,3k+2)
+	TRIANGLE_STRIP,	//triangle k is (k,k+1,k+2), with the first two swapped on odd k so every triangle has the same winding
+	TRIANGLE_FAN	//triangle k is (0,k+1,k+2)
+};
+
+//This is primitive assembly: it turns an index buffer into numbered triangles according to a topology.  With a restart index,
+//that index ends the current strip, fan or list and the next one starts after it, like GL_PRIMITIVE_RESTART.
+//The restart positions are found once when this is constructed, so any triangle can be looked up independently and in parallel.
+//It only points into the index buffer, which has to outlive it.
+template<class IndexType>
+class PrimitiveAssembler
+{
+protected:
+	//a run of indices between restarts
+	struct Segment
+	{
+		std::size_t first;
+		std::size_t first_triangle;
+	};
+	const IndexType* indices;
+	Topology topology;
+	std::vector<Segment> segments;
+	std::size_t num_triangles;
+
+	void add_segment(std::size_t first,std::size_t count)
+	{
+		std::size_t n=topology==Topology::TRIANGLE_LIST ? count/3 : (count >= 3 ? count-2 : 0);
+		if(n)
+		{
+			Segment sg={first,num_triangles};
+			segments.push_back(sg);
+			num_triangles+=n;
+		}
+	}
+public:
+	PrimitiveAssembler(const IndexType* ib,const IndexType* ie,Topology t=Topology::TRIANGLE_LIST):
+		indices(ib),topology(t),num_triangles(0)
+	{
+		add_segment(0,ie-ib);
+	}
+	PrimitiveAssembler(const IndexType* ib,const IndexType* ie,Topology t,IndexType restart_index):
+		indices(ib),topology(t),num_triangles(0)
+	{
+		std::size_t n=ie-ib;
+		std::size_t first=0;
+		for(std::size_t i=0;i<n;i++)
+		{
+			if(ib[i]==restart_index)
+			{
+				add_segment(first,i-first);
+				first=i+1;
+			}
+		}
+		add_segment(first,n-first);
+	}
+	//The number of triangles
+	std::size_t size() const
+	{
+		return num_triangles;
+	}
+	//The vertex indices of triangle t
+	std::array<IndexType,3> operator[](std::size_t t) const
+	{
+		std::size_t s=0;
+		if(segments.size() > 1)
+		{
+			s=std::upper_bound(segments.begin(),segments.end(),t,
+				[](std::size_t tt,const Segment& sg) { return tt < sg.first_triangle; })-segments.begin()-1;
+		}
+		std::size_t k=t-segments[s].first_triangle;
+		const IndexType* si=indices+segments[s].first;
+		switch(topology)
+		{
+		case Topology::TRIANGLE_STRIP:
+			if(k & 1)
+			{
+				return std::array<IndexType,3>{{si[k+1],si[k],si[k+2]}};
+			}
+			return std::array<IndexType,3>{{si[k],si[k+1],si[k+2]}};
+		case Topology::TRIANGLE_FAN:
+			return std::array<IndexType,3>{{si[0],si[k+1],si[k+2]}};
+		default:
+			return std::array<IndexType,3>{{si[3*k],si[3*k+1],si[3*k+2]}};
+		}
+	}
+	//The shaded vertices of triangle t
+	template<class VertexVsOut>
+	std::array<VertexVsOut,3> triangle(std::size_t t,const VertexVsOut* verts) const
+	{
+		std::array<IndexType,3> ti=(*this)[t];
+		return std::array<VertexVsOut,3>{{verts[ti[0]],verts[ti[1]],verts[ti[2]]}};
+	}
+};
+
+//The usual primitive restart index for an index type: its largest value
+template<class IndexType>
+IndexType primitive_restart_index()
+{
+	return std::numeric_limits<IndexType>::max();
+}
+
+//This sorts triangles into the tiles of a grid over the image by their bounding boxes.  Each tile gets the list of
+//triangles that touch it in submission order, so the tiles can then be rasterized independently (and in parallel) with no
+//two threads ever touching the same pixel.
+class TriangleBins
+{
+public:
+	const std::size_t width;
+	const std::size_t height;
+	const std::size_t tile_width;
+	const std::size_t tile_height;
+	const std::size_t tiles_x;
+	const std::size_t tiles_y;
+	std::vector<std::vector<std::size_t>> bins;
+
+	TriangleBins(std::size_t w,std::size_t h,std::size_t tw,std::size_t th):
+		width(w),height(h),
+		tile_width(tw),tile_height(th),
+		tiles_x((w+tw-1)/tw),tiles_y((h+th-1)/th),
+		bins(tiles_x*tiles_y)
+	{}
+	//Adds triangle t, which covers the pixels [ul,lr), to every tile it overlaps
+	void add(std::size_t t,const Eigen::Array2i& ul,const Eigen::Array2i& lr)
+	{
+		if((lr <= ul).any())
+		{
+			return;
+		}
+		for(std::size_t ty=ul[1]/tile_height;ty<=(lr[1]-1)/tile_height;ty++)
+		for(std::size_t tx=ul[0]/tile_width;tx<=(lr[0]-1)/tile_width;tx++)
+		{
+			bins[ty*tiles_x+tx].push_back(t);
+		}
+	}
+	//The pixels [ul,lr) of tile i
+	void tile(std::size_t i,Eigen::Array2i& ul,Eigen::Array2i& lr) const
+	{
+		ul=Eigen::Array2i((i%tiles_x)*tile_width,(i/tiles_x)*tile_height);
+		lr=(ul+Eigen::Array2i(tile_width,tile_height)).min(Eigen::Array2i(width,height));
+	}
+	void clear()
+	{
+		for(std::size_t i=0;i<bins.size();i++)
+		{
+			bins[i].clear();
+		}
+	}
+};
+
+namespace detail
+{
+//This bins triangles [0,n) into num_sets sets of bins at once, like the views of a multi-view draw.  bin(t,sets) is called once for
+//each triangle and adds it to whichever of sets[0,num_sets) it covers, so anything shared by the sets is only read once per triangle.
+//Big batches are binned in parallel in fixed size chunks that are merged in order, so the bins are the same for any number of threads.
+template<class BinFn>
+void bin_triangles_sets(TriangleBins* bins,std::size_t num_sets,std::size_t n,BinFn bin)
+{
+	static const std::size_t CHUNK=16384;
+	std::size_t num_chunks=(n+CHUNK-1)/CHUNK;
+	if(num_chunks <= 1)
+	{
+		for(std::size_t t=0;t<n;t++)
+		{
+			bin(t,bins);
+		}
+		return;
+	}
+	std::vector<TriangleBins> chunks;
+	chunks.reserve(num_chunks*num_sets);
+	for(std::size_t c=0;c<num_chunks;c++)
+	for(std::size_t s=0;s<num_sets;s++)
+	{
+		chunks.push_back(TriangleBins(bins[s].width,bins[s].height,bins[s].tile_width,bins[s].tile_height));
+	}
+	#pragma omp parallel for schedule(dynamic)
+	for(std::size_t c=0;c<num_chunks;c++)
+	{
+		for(std::size_t t=c*CHUNK;t<std::min(n,(c+1)*CHUNK);t++)
+		{
+			bin(t,&chunks[c*num_sets]);
+		}
+	}
+	for(std::size_t s=0;s<num_sets;s++)
+	{
+		#pragma omp parallel for schedule(dynamic)
+		for(std::size_t i=0;i<bins[s].bins.size();i++)
+		{
+			for(std::size_t c=0;c<num_chunks;c++)
+			{
+				const std::vector<std::size_t>& cb=chunks[c*num_sets+s].bins[i];
+				bins[s].bins[i].insert(bins[s].bins[i].end(),cb.begin(),cb.end());
+			}
+		}
+	}
+}
+//This bins triangles [0,n), where bounds(t,ul,lr) gives the pixels [ul,lr) that triangle t covers.
+template<class BoundsFn>
+void bin_triangles(TriangleBins& bins,std::size_t n,BoundsFn bounds)
+{
+	bin_triangles_sets(&bins,1,n,[&](std::size_t t,TriangleBins* sets)
+		{
+			Eigen::Array2i ul,lr;
+			bounds(t,ul,lr);
+			sets[0].add(t,ul,lr);
+		});
+}
+
+//This rasterizes triangles [0,n) tile by tile: they are binned, then the tiles are rasterized in parallel with each tile
+//drawing its triangles in order.  No two threads write the same pixel, so the result doesn't depend on the thread count or timing.
+template<class Target,class TriangleFn,class FragShader>
+void rasterize_binned(Target& fb,std::size_t n,TriangleFn triangle,FragShader& fragment_shader,std::size_t tile_size)
+{
+	TriangleBins bins(fb.width,fb.height,tile_size,tile_size);
+	bin_triangles(bins,n,[&](std::size_t t,Eigen::Array2i& ul,Eigen::Array2i& lr) { triangle_bounds(fb,triangle(t),ul,lr); });
+	#pragma omp parallel for schedule(dynamic)
+	for(std::size_t i=0;i<bins.bins.size();i++)
+	{
+		Eigen::Array2i ul,lr;
+		bins.tile(i,ul,lr);
+		const std::vector<std::size_t>& tris=bins.bins[i];
+		for(std::size_t k=0;k<tris.size();k++)
+		{
+			auto tri=triangle(tris[k]);
+			TriangleSetup ts=triangle_setup(fb,tri);
+			ts.clip(ul,lr);
+			rasterize_triangle(fb,ts,tri,fragment_shader);
+		}
+	}
+}
+}
+
+//This bins every triangle of a PrimitiveAssembler.  The triangle numbers stored in the bins are the ones the assembler uses.
+//padding grows each bounding box to the bottom right, see bounds_padding.
+template<class IndexType,class VertexVsOut>
+void bin_triangles(TriangleBins& bins,const PrimitiveAssembler<IndexType>& primitives,const VertexVsOut* verts,int padding=0)
+{
+	Eigen::Array2i isz(bins.width,bins.height);
+	detail::bin_triangles(bins,primitives.size(),[&](std::size_t t,Eigen::Array2i& ul,Eigen::Array2i& lr)
+		{
+			TriangleSetup::bounds(TriangleSetup::divide(primitives.triangle(t,verts)),isz,ul,lr);
+			lr=(lr+padding).min(isz);
+		});
+}
+//This bins every triangle of a triangle list index buffer.  Triangle t is indices [3t,3t+3).
+template<class IndexType,class VertexVsOut>
+void bin_triangles(TriangleBins& bins,const IndexType* ib,const IndexType* ie,const VertexVsOut* verts)
+{
+	bin_triangles(bins,PrimitiveAssembler<IndexType>(ib,ie),verts);
+}
+
+//How rasterize spreads triangles over threads.  FAST rasterizes triangles in parallel straight into the target, so where
+//triangles overlap the result can depend on thread timing.  DETERMINISTIC bins the triangles into tiles and rasterizes the tiles
+//in parallel, each in submission order, so the output is bit for bit the same for any number of threads, at the cost of the binning.
+//The mode is global and should be set before drawing.  Defining URASTER_DETERMINISTIC makes DETERMINISTIC the default.
+enum class RasterMode
+{
+	FAST,
+	DETERMINISTIC
+};
+namespace detail
+{
+inline RasterMode& raster_mode_setting()
+{
+#ifdef URASTER_DETERMINISTIC
+	static RasterMode mode=RasterMode::DETERMINISTIC;
+#else
+	static RasterMode mode=RasterMode::FAST;
+#endif
+	return mode;
+}
+}
+inline RasterMode raster_mode()
+{
+	return detail::raster_mode_setting();
+}
+inline void set_raster_mode(RasterMode m)
+{
+	detail::raster_mode_setting()=m;
+}
+namespace detail
+{
+//Whether drawing with this target and fragment shader has to go through the binned rasterizer
+template<class Target,class FragShader>
+bool use_binned_raster()
+{
+	return raster_mode()==RasterMode::DETERMINISTIC || is_blended<FragShader>::value || is_ordered_target<Target>::value;
+}
+}
+
+//This function rasterizes the triangles put together by a PrimitiveAssembler from a buffer of output verts.
+//Target is any framebuffer that has a rasterize_triangle overload.
+template<class Target,class IndexType,class VertexVsOut,class FragShader>
+void rasterize(Target& fb,const PrimitiveAssembler<IndexType>& primitives,const VertexVsOut* verts,
+	FragShader fragment_shader)
+{
+	std::size_t n=primitives.size();
+	if(detail::use_binned_raster<Target,FragShader>())
+	{
+		detail::rasterize_binned(fb,n,[&](std::size_t t) { return primitives.triangle(t,verts); },fragment_shader,64);
+		return;
+	}
+	#pragma omp parallel for
+	for(std::size_t t=0;t<n;t++)
+	{
+		rasterize_triangle(fb,primitives.triangle(t,verts),fragment_shader);
+	}
+}
+
+//This function rasterizes a list of triangles determined by an index buffer and a buffer of output verts.
+//IndexType can be any integer type, so 16 and 32 bit index buffers are used as they are.
+template<class Target,class IndexType,class VertexVsOut,class FragShader>
+void rasterize(Target& fb,const IndexType* ib,const IndexType* ie,const VertexVsOut* verts,
+	FragShader fragment_shader)
+{
+	rasterize(fb,PrimitiveAssembler<IndexType>(ib,ie),verts,fragment_shader);
+}
+
+namespace detail
+{
+//This presents rows [y0,y0+fb.height) of a larger image, whose full size is width x height, as the whole image.
+//The rasterizer maps triangles to pixels using the full image size and writes through to the smaller framebuffer.
+template<class Fb>
+struct BandFramebuffer
+{
+	Fb& fb;
+	const std::size_t y0;
+	const std::size_t width;
+	const std::size_t height;
+	BandFramebuffer(Fb& b,std::size_t y,std::size_t w,std::size_t h):
+		fb(b),y0(y),width(w),height(h)
+	{}
+	auto operator()(std::size_t x,std::size_t y) -> decltype(fb(x,y))
+	{
+		return fb(x,y-y0);
+	}
+};
+}
+
+//This renders an image too big to keep in memory in horizontal bands of band_height rows.  All the triangles are vertex shaded and
+//binned once, then each band is cleared to clear_pixel, rasterized in parallel tiles, and passed to band_out before the next band reuses
+//the same memory.  band_out is called as band_out(const Framebuffer<PixelOut>& band,std::size_t y0,std::size_t rows) with the bands in order,
+//where row r of the band is row y0+r of the image and only the first rows rows are valid.  Peak memory is one band plus the vertex cache and bins.
+//band_height must be at least 1, or std::invalid_argument is thrown.
+template<class PixelOut,class IndexType,class VertexVsOut,class VertexVsIn,class VertShader,class FragShader,class BandOut>
+void draw_banded(std::size_t width,std::size_t height,std::size_t band_height,const PixelOut& clear_pixel,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		FragShader fragment_shader,
+		BandOut band_out)
+{
+	if(band_height==0)
+	{
+		throw std::invalid_argument("uraster::draw_banded: band_height must be at least 1");
+	}
+	std::unique_ptr<VertexVsOut[]> vc;
+	if(vcache_b==NULL || (vcache_e-vcache_b) != (vertexbuffer_e-vertexbuffer_b))
+	{
+		vcache_b=new VertexVsOut[(vertexbuffer_e-vertexbuffer_b)];
+		vc.reset(vcache_b);
+	}
+	run_vertex_shader(vertexbuffer_b,vertexbuffer_e,vcache_b,vertex_shader);
+
+	//the bands are split into columns of tiles so there is parallel work inside each band
+	TriangleBins bins(width,height,64,band_height);
+	PrimitiveAssembler<IndexType> primitives(indexbuffer_b,indexbuffer_e);
+	bin_triangles(bins,primitives,vcache_b);
+
+	Framebuffer<PixelOut> band(width,band_height,clear_pixel);
+	for(std::size_t by=0;by<bins.tiles_y;by++)
+	{
+		std::size_t y0=by*band_height;
+		detail::BandFramebuffer<Framebuffer<PixelOut> > bfb(band,y0,width,height);
+		band.clear(clear_pixel);
+		#pragma omp parallel for schedule(dynamic)
+		for(std::size_t bx=0;bx<bins.tiles_x;bx++)
 		{
-			float d=bary[0]*epoints[0][2]+bary[1]*epoints[1][2]+bary[2]*epoints[2][2];
-			//Reference the current pixel at that coordinate
-			PixelOut& po=fb(x,y);
-			// if the interpolated depth passes the depth test
-			if(po.depth() < d && d < 1.0)
+			std::size_t t=by*bins.tiles_x+bx;
+			Eigen::Array2i ul,lr;
+			bins.tile(t,ul,lr);
+			const std::vector<std::size_t>& tris=bins.bins[t];
+			for(std::size_t k=0;k<tris.size();k++)
 			{
-				//interpolate varying parameters
-				VertexVsOut v=verts[0];
-				v*=bary[0];
-				VertexVsOut vt=verts[1];
-				vt*=bary[1];
-				v+=vt;
-				vt=verts[2];
-				vt*=bary[2];
-				v+=vt;
-				
-				//call the fragment shader
-				po=fragment_shader(v);
-				po.depth()=d; //write the depth buffer
+				std::array<VertexVsOut,3> tri=primitives.triangle(tris[k],static_cast<const VertexVsOut*>(vcache_b));
+				TriangleSetup ts(tri,width,height);
+				ts.clip(ul,lr);
+				detail::rasterize_triangle_pixels<PixelOut>(bfb,ts,tri,fragment_shader);
 			}
 		}
+		band_out(static_cast<const Framebuffer<PixelOut>&>(band),y0,std::min(band_height,height-y0));
 	}
 }
 
-
-//This function rasterizes a set of triangles determined by an index buffer and a buffer of output verts.
-template<class PixelOut,class VertexVsOut,class FragShader>
-void rasterize(Framebuffer<PixelOut>& fb,const std::size_t* ib,const std::size_t* ie,const VertexVsOut* verts,
-	FragShader fragment_shader)
+//This function does a draw call of the triangles put together by a PrimitiveAssembler
+template<class Target,class IndexType,class VertexVsOut,class VertexVsIn,class VertShader, class FragShader>
+void draw(	Target& fb,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const PrimitiveAssembler<IndexType>& primitives,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		FragShader fragment_shader)
 {
-	std::size_t n=ie-ib;
-	#pragma omp parallel for
-	for(std::size_t i=0;i<n;i+=3)
+	std::unique_ptr<VertexVsOut[]> vc;
+	if(vcache_b==NULL || (vcache_e-vcache_b) != (vertexbuffer_e-vertexbuffer_b))
 	{
-		const std::size_t* ti=ib+i;
-		std::array<VertexVsOut,3> tri{{verts[ti[0]],verts[ti[1]],verts[ti[2]]}};
-		rasterize_triangle(fb,tri,fragment_shader);
+		vcache_b=new VertexVsOut[(vertexbuffer_e-vertexbuffer_b)];
+		vc.reset(vcache_b);
 	}
+	run_vertex_shader(vertexbuffer_b,vertexbuffer_e,vcache_b,vertex_shader);
+	rasterize(fb,primitives,vcache_b,fragment_shader);
 }
 
 //This function does a draw call from an indexed buffer
-template<class PixelOut,class VertexVsOut,class VertexVsIn,class VertShader, class FragShader>
-void draw(	Framebuffer<PixelOut>& fb,
+template<class Target,class IndexType,class VertexVsOut,class VertexVsIn,class VertShader, class FragShader>
+void draw(	Target& fb,
 		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
-		const std::size_t* indexbuffer_b,const std::size_t* indexbuffer_e,
+		const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		FragShader fragment_shader)
+{
+	draw(fb,vertexbuffer_b,vertexbuffer_e,PrimitiveAssembler<IndexType>(indexbuffer_b,indexbuffer_e),vcache_b,vcache_e,vertex_shader,fragment_shader);
+}
+
+//This does a draw call whose vertices are assembled from the attribute streams of a VertexArray
+template<class Target,class IndexType,class VertexVsOut,class VertShader, class FragShader>
+void draw(	Target& fb,
+		const VertexArray& vertexarray,
+		const PrimitiveAssembler<IndexType>& primitives,
 		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
 		VertShader vertex_shader,
 		FragShader fragment_shader)
 {
 	std::unique_ptr<VertexVsOut[]> vc;
-	if(vcache_b==NULL || (vcache_e-vcache_b) != (vertexbuffer_e-vertexbuffer_b))
+	if(vcache_b==NULL || static_cast<std::size_t>(vcache_e-vcache_b) != vertexarray.num_vertices)
 	{
-		vcache_b=new VertexVsOut[(vertexbuffer_e-vertexbuffer_b)];
+		vcache_b=new VertexVsOut[vertexarray.num_vertices];
 		vc.reset(vcache_b);
 	}
-	run_vertex_shader(vertexbuffer_b,vertexbuffer_e,vcache_b,vertex_shader);
-	rasterize(fb,indexbuffer_b,indexbuffer_e,vcache_b,fragment_shader);
+	run_vertex_shader(vertexarray,vcache_b,vertex_shader);
+	rasterize(fb,primitives,vcache_b,fragment_shader);
+}
+template<class Target,class IndexType,class VertexVsOut,class VertShader, class FragShader>
+void draw(	Target& fb,
+		const VertexArray& vertexarray,
+		const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		FragShader fragment_shader)
+{
+	draw(fb,vertexarray,PrimitiveAssembler<IndexType>(indexbuffer_b,indexbuffer_e),vcache_b,vcache_e,vertex_shader,fragment_shader);
+}
+
+//This draws the same mesh once for each element of an instance buffer.  The vertex shader is called as
+//vertex_shader(const VertexVsIn& v,const InstanceData& instance,std::size_t instance_id) and the vertex cache holds every
+//instance's vertices one instance after another, so it needs (vertexbuffer_e-vertexbuffer_b)*(instances_e-instances_b) entries.
+//Vertex shading and rasterization of all the instances happen inside one parallel region, so a batch of instances only
+//pays the threading overhead of a single draw.
+template<class Target,class IndexType,class VertexVsOut,class VertexVsIn,class InstanceData,class VertShader, class FragShader>
+void draw_instanced(	Target& fb,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const PrimitiveAssembler<IndexType>& primitives,
+		const InstanceData* instances_b,const InstanceData* instances_e,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		FragShader fragment_shader)
+{
+	std::size_t num_vertices=vertexbuffer_e-vertexbuffer_b;
+	std::size_t num_instances=instances_e-instances_b;
+	std::size_t num_triangles=primitives.size();
+	std::unique_ptr<VertexVsOut[]> vc;
+	if(vcache_b==NULL || static_cast<std::size_t>(vcache_e-vcache_b) != num_vertices*num_instances)
+	{
+		vcache_b=new VertexVsOut[num_vertices*num_instances];
+		vc.reset(vcache_b);
+	}
+	const VertexVsOut* vcache=vcache_b;
+
+	if(detail::use_binned_raster<Target,FragShader>())
+	{
+		#pragma omp parallel for
+		for(std::size_t i=0;i<num_vertices*num_instances;i++)
+		{
+			std::size_t instance=i/num_vertices;
+			vcache_b[i]=vertex_shader(vertexbuffer_b[i%num_vertices],instances_b[instance],instance);
+		}
+		detail::rasterize_binned(fb,num_triangles*num_instances,[&](std::size_t j)
+			{
+				return primitives.triangle(j%num_triangles,vcache+(j/num_triangles)*num_vertices);
+			},fragment_shader,64);
+		return;
+	}
+	#pragma omp parallel
+	{
+		#pragma omp for
+		for(std::size_t i=0;i<num_vertices*num_instances;i++)
+		{
+			std::size_t instance=i/num_vertices;
+			vcache_b[i]=vertex_shader(vertexbuffer_b[i%num_vertices],instances_b[instance],instance);
+		}
+		//the implied barrier here means every vertex is shaded before any triangle uses it
+		#pragma omp for
+		for(std::size_t j=0;j<num_triangles*num_instances;j++)
+		{
+			std::size_t instance=j/num_triangles;
+			rasterize_triangle(fb,primitives.triangle(j%num_triangles,vcache+instance*num_vertices),fragment_shader);
+		}
+	}
+}
+template<class Target,class IndexType,class VertexVsOut,class VertexVsIn,class InstanceData,class VertShader, class FragShader>
+void draw_instanced(	Target& fb,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		const InstanceData* instances_b,const InstanceData* instances_e,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		FragShader fragment_shader)
+{
+	draw_instanced(fb,vertexbuffer_b,vertexbuffer_e,PrimitiveAssembler<IndexType>(indexbuffer_b,indexbuffer_e),
+		instances_b,instances_e,vcache_b,vcache_e,vertex_shader,fragment_shader);
+}
+
+//This draws one mesh into several views at once, like cube map faces or the cameras of a rig.  The vertex shader runs once per vertex
+//for everything the views share, then view_shader(const VertexVsOut& v,std::size_t view) gives the clip position of v in each view,
+//usually by multiplying a world position by that view's matrix.  targets holds one target per view, such as the layers of a
+//framebuffer array or ViewportTargets into an atlas.  Each triangle is read from the index buffer once and drawn into every view it
+//lands in, and views it misses are skipped after one setup that also gives the bounds.  The fragment shader is shared and gets the
+//interpolated VertexVsOut.
+template<class Target,class IndexType,class VertexVsOut,class VertexVsIn,class VertShader,class ViewShader,class FragShader>
+void draw_multiview(	Target* targets_b,Target* targets_e,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const PrimitiveAssembler<IndexType>& primitives,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		ViewShader view_shader,
+		FragShader fragment_shader)
+{
+	std::size_t num_views=targets_e-targets_b;
+	std::size_t num_vertices=vertexbuffer_e-vertexbuffer_b;
+	std::size_t num_triangles=primitives.size();
+	std::unique_ptr<VertexVsOut[]> vc;
+	if(vcache_b==NULL || static_cast<std::size_t>(vcache_e-vcache_b) != num_vertices)
+	{
+		vcache_b=new VertexVsOut[num_vertices];
+		vc.reset(vcache_b);
+	}
+	const VertexVsOut* vcache=vcache_b;
+	std::unique_ptr<Eigen::Vector4f[]> positions(new Eigen::Vector4f[num_vertices*num_views]);
+
+	#pragma omp parallel for
+	for(std::size_t i=0;i<num_vertices;i++)
+	{
+		vcache_b[i]=vertex_shader(vertexbuffer_b[i]);
+		for(std::size_t view=0;view<num_views;view++)
+		{
+			positions[view*num_vertices+i]=view_shader(vcache_b[i],view);
+		}
+	}
+	//triangle ti as the view sees it
+	auto triangle=[&](const std::array<IndexType,3>& ti,std::size_t view)
+	{
+		const Eigen::Vector4f* vp=positions.get()+view*num_vertices;
+		ViewVertex<VertexVsOut> v0={vcache+ti[0],vp[ti[0]]},v1={vcache+ti[1],vp[ti[1]]},v2={vcache+ti[2],vp[ti[2]]};
+		return std::array<ViewVertex<VertexVsOut>,3>{{v0,v1,v2}};
+	};
+
+	if(detail::use_binned_raster<Target,FragShader>())
+	{
+		//one pass over the triangles bins each one into every view, then the tiles of all the views are rasterized together
+		std::vector<TriangleBins> bins;
+		for(std::size_t view=0;view<num_views;view++)
+		{
+			bins.push_back(TriangleBins(targets_b[view].width,targets_b[view].height,64,64));
+		}
+		detail::bin_triangles_sets(bins.data(),num_views,num_triangles,[&](std::size_t t,TriangleBins* view_bins)
+			{
+				std::array<IndexType,3> ti=primitives[t];
+				for(std::size_t view=0;view<num_views;view++)
+				{
+					Eigen::Array2i ul,lr;
+					triangle_bounds(targets_b[view],triangle(ti,view),ul,lr);
+					view_bins[view].add(t,ul,lr);
+				}
+			});
+		std::vector<std::pair<std::size_t,std::size_t> > tiles;
+		for(std::size_t view=0;view<num_views;view++)
+		{
+			for(std::size_t i=0;i<bins[view].bins.size();i++)
+			{
+				if(!bins[view].bins[i].empty())
+				{
+					tiles.push_back(std::make_pair(view,i));
+				}
+			}
+		}
+		#pragma omp parallel for schedule(dynamic)
+		for(std::size_t j=0;j<tiles.size();j++)
+		{
+			std::size_t view=tiles[j].first;
+			Eigen::Array2i ul,lr;
+			bins[view].tile(tiles[j].second,ul,lr);
+			const std::vector<std::size_t>& tris=bins[view].bins[tiles[j].second];
+			for(std::size_t k=0;k<tris.size();k++)
+			{
+				std::array<ViewVertex<VertexVsOut>,3> tri=triangle(primitives[tris[k]],view);
+				TriangleSetup ts=triangle_setup(targets_b[view],tri);
+				ts.clip(ul,lr);
+				rasterize_triangle(targets_b[view],ts,tri,fragment_shader);
+			}
+		}
+		return;
+	}
+	#pragma omp parallel for
+	for(std::size_t t=0;t<num_triangles;t++)
+	{
+		std::array<IndexType,3> ti=primitives[t];
+		for(std::size_t view=0;view<num_views;view++)
+		{
+			std::array<ViewVertex<VertexVsOut>,3> tri=triangle(ti,view);
+			TriangleSetup ts=triangle_setup(targets_b[view],tri);
+			if((ts.ibb_ul < ts.ibb_lr).all())
+			{
+				rasterize_triangle(targets_b[view],ts,tri,fragment_shader);
+			}
+		}
+	}
+}
+template<class Target,class IndexType,class VertexVsOut,class VertexVsIn,class VertShader,class ViewShader,class FragShader>
+void draw_multiview(	Target* targets_b,Target* targets_e,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		VertexVsOut* vcache_b,VertexVsOut* vcache_e,
+		VertShader vertex_shader,
+		ViewShader view_shader,
+		FragShader fragment_shader)
+{
+	draw_multiview(targets_b,targets_e,vertexbuffer_b,vertexbuffer_e,PrimitiveAssembler<IndexType>(indexbuffer_b,indexbuffer_e),
+		vcache_b,vcache_e,vertex_shader,view_shader,fragment_shader);
+}
+
+//How draw_batch spreads work over threads.  INTRA_IMAGE renders the images one after another, each with every thread like draw does.
+//INTER_IMAGE renders whole images on separate threads, each drawn serially, which scales much better when the images are small.
+//AUTO picks INTER_IMAGE when the images are at most BATCH_INTER_IMAGE_PIXELS pixels each and there are at least as many as threads,
+//so every thread gets an image.  Otherwise it picks INTRA_IMAGE.
+enum class BatchParallelism
+{
+	AUTO,
+	INTRA_IMAGE,
+	INTER_IMAGE
+};
+static const std::size_t BATCH_INTER_IMAGE_PIXELS=256*256;
+
+//This renders one mesh into many independent targets, like the poses or cameras of a dataset.  jobs holds one entry per target with
+//whatever differs between the images, and the vertex shader is called as vertex_shader(const VertexVsIn& v,const Job& job).
+//Each thread keeps one vertex cache for all the images it renders.  Images drawn serially are rasterized in submission order,
+//so INTER_IMAGE output doesn't depend on the raster mode or the number of threads.
+template<class Target,class Job,class IndexType,class VertexVsIn,class VertShader,class FragShader>
+void draw_batch(	Target* targets_b,Target* targets_e,
+		const Job* jobs,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const PrimitiveAssembler<IndexType>& primitives,
+		VertShader vertex_shader,
+		FragShader fragment_shader,
+		BatchParallelism parallelism=BatchParallelism::AUTO)
+{
+	typedef typename std::decay<decltype(vertex_shader(*vertexbuffer_b,*jobs))>::type VertexVsOut;
+	std::size_t num_images=targets_e-targets_b;
+	std::size_t num_vertices=vertexbuffer_e-vertexbuffer_b;
+	std::size_t num_triangles=primitives.size();
+	if(parallelism==BatchParallelism::AUTO)
+	{
+		std::size_t max_pixels=0;
+		for(std::size_t k=0;k<num_images;k++)
+		{
+			max_pixels=std::max<std::size_t>(max_pixels,targets_b[k].width*targets_b[k].height);
+		}
+#ifdef _OPENMP
+		std::size_t num_threads=omp_get_max_threads();
+#else
+		std::size_t num_threads=1;
+#endif
+		parallelism=(num_images > 1 && num_images >= num_threads && max_pixels <= BATCH_INTER_IMAGE_PIXELS) ?
+			BatchParallelism::INTER_IMAGE : BatchParallelism::INTRA_IMAGE;
+	}
+
+	if(parallelism==BatchParallelism::INTRA_IMAGE)
+	{
+		std::unique_ptr<VertexVsOut[]> vcache(new VertexVsOut[num_vertices]);
+		for(std::size_t k=0;k<num_images;k++)
+		{
+			const Job& job=jobs[k];
+			#pragma omp parallel for
+			for(std::size_t i=0;i<num_vertices;i++)
+			{
+				vcache[i]=vertex_shader(vertexbuffer_b[i],job);
+			}
+			rasterize(targets_b[k],primitives,static_cast<const VertexVsOut*>(vcache.get()),fragment_shader);
+		}
+		return;
+	}
+	#pragma omp parallel
+	{
+		std::unique_ptr<VertexVsOut[]> vcache(new VertexVsOut[num_vertices]);
+		#pragma omp for schedule(dynamic)
+		for(std::size_t k=0;k<num_images;k++)
+		{
+			for(std::size_t i=0;i<num_vertices;i++)
+			{
+				vcache[i]=vertex_shader(vertexbuffer_b[i],jobs[k]);
+			}
+			for(std::size_t t=0;t<num_triangles;t++)
+			{
+				rasterize_triangle(targets_b[k],primitives.triangle(t,static_cast<const VertexVsOut*>(vcache.get())),fragment_shader);
+			}
+		}
+	}
+}
+template<class Target,class Job,class IndexType,class VertexVsIn,class VertShader,class FragShader>
+void draw_batch(	Target* targets_b,Target* targets_e,
+		const Job* jobs,
+		const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		VertShader vertex_shader,
+		FragShader fragment_shader,
+		BatchParallelism parallelism=BatchParallelism::AUTO)
+{
+	draw_batch(targets_b,targets_e,jobs,vertexbuffer_b,vertexbuffer_e,PrimitiveAssembler<IndexType>(indexbuffer_b,indexbuffer_e),
+		vertex_shader,fragment_shader,parallelism);
+}
+
+namespace detail
+{
+//Vertex sources for CommandBuffer, which read vertex i from an array of vertex structs or from a VertexArray
+template<class VertexVsIn>
+struct PointerVertices
+{
+	const VertexVsIn* vertices;
+	std::size_t size;
+	const VertexVsIn& operator[](std::size_t i) const
+	{
+		return vertices[i];
+	}
+};
+struct ArrayVertices
+{
+	VertexArray vertexarray;
+	std::size_t size;
+	VertexInput operator[](std::size_t i) const
+	{
+		VertexInput vi;
+		vertexarray.fetch(i,vi);
+		return vi;
+	}
+};
 }
 
+//This records draw calls to run later as one job.  Each recorded draw keeps its own copy of its shaders, so uniforms captured by
+//value in the shaders are recorded with it, but the vertex and index buffers are only pointed to and have to stay alive until execute.
+//execute shades the vertices of every draw in one parallel loop, bins the triangles of all the draws into one set of tiles in
+//submission order, and then rasterizes the tiles in parallel.  Since each tile draws its triangles in the order they were recorded,
+//the result is the same as drawing them one at a time, and no two threads ever write the same pixel.
+//Target is any framebuffer with a rasterize_triangle overload taking a TriangleSetup.
+template<class Target>
+class CommandBuffer
+{
+protected:
+	struct Command
+	{
+		virtual ~Command() {}
+		//a copy of the draw with its own vertex cache
+		virtual Command* clone() const=0;
+		virtual std::size_t num_vertices() const=0;
+		virtual std::size_t num_triangles() const=0;
+		//runs the vertex shader on vertices [b,e)
+		virtual void shade(std::size_t b,std::size_t e)=0;
+		virtual void bounds(const Target& fb,std::size_t t,Eigen::Array2i& ul,Eigen::Array2i& lr) const=0;
+		//rasterizes the part of triangle t in the pixels [ul,lr)
+		virtual void rasterize(Target& fb,std::size_t t,const Eigen::Array2i& ul,const Eigen::Array2i& lr)=0;
+	};
+	template<class VertexSource,class IndexType,class VertexVsOut,class VertShader,class FragShader>
+	struct DrawCommand: public Command
+	{
+		VertexSource vertices;
+		PrimitiveAssembler<IndexType> primitives;
+		VertShader vertex_shader;
+		FragShader fragment_shader;
+		std::unique_ptr<VertexVsOut[]> vcache;
+
+		DrawCommand(const VertexSource& vsrc,const PrimitiveAssembler<IndexType>& p,VertShader vs,FragShader fs):
+			vertices(vsrc),primitives(p),
+			vertex_shader(vs),fragment_shader(fs),
+			vcache(new VertexVsOut[vsrc.size])
+		{}
+		Command* clone() const
+		{
+			return new DrawCommand(vertices,primitives,vertex_shader,fragment_shader);
+		}
+		std::size_t num_vertices() const
+		{
+			return vertices.size;
+		}
+		std::size_t num_triangles() const
+		{
+			return primitives.size();
+		}
+		void shade(std::size_t b,std::size_t e)
+		{
+			for(std::size_t i=b;i<e;i++)
+			{
+				vcache[i]=vertex_shader(vertices[i]);
+			}
+		}
+		void bounds(const Target& fb,std::size_t t,Eigen::Array2i& ul,Eigen::Array2i& lr) const
+		{
+			triangle_bounds(fb,primitives.triangle(t,static_cast<const VertexVsOut*>(vcache.get())),ul,lr);
+		}
+		void rasterize(Target& fb,std::size_t t,const Eigen::Array2i& ul,const Eigen::Array2i& lr)
+		{
+			std::array<VertexVsOut,3> tri=primitives.triangle(t,static_cast<const VertexVsOut*>(vcache.get()));
+			TriangleSetup ts=triangle_setup(fb,tri);
+			ts.clip(ul,lr);
+			rasterize_triangle(fb,ts,tri,fragment_shader);
+		}
+	};
+	template<class VertexSource,class IndexType,class VertShader,class FragShader>
+	void record(const VertexSource& vsrc,const PrimitiveAssembler<IndexType>& primitives,VertShader vertex_shader,FragShader fragment_shader)
+	{
+		typedef typename std::decay<decltype(vertex_shader(vsrc[0]))>::type VertexVsOut;
+		commands.push_back(std::unique_ptr<Command>(
+			new DrawCommand<VertexSource,IndexType,VertexVsOut,VertShader,FragShader>(vsrc,primitives,vertex_shader,fragment_shader)));
+	}
+
+	std::vector<std::unique_ptr<Command>> commands;
+	std::unique_ptr<TriangleBins> bins;
+	std::size_t tile_size;
+public:
+	//vertices are shaded in chunks of this many, so big and small draws balance across threads
+	static const std::size_t VERTEX_CHUNK=1024;
+
+	explicit CommandBuffer(std::size_t ts=64):
+		tile_size(ts)
+	{}
+	//Records a draw.  The arguments are the same as uraster::draw without the target and vertex cache.
+	template<class VertexVsIn,class IndexType,class VertShader,class FragShader>
+	void draw(const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const PrimitiveAssembler<IndexType>& primitives,
+		VertShader vertex_shader,FragShader fragment_shader)
+	{
+		detail::PointerVertices<VertexVsIn> vsrc={vertexbuffer_b,static_cast<std::size_t>(vertexbuffer_e-vertexbuffer_b)};
+		record(vsrc,primitives,vertex_shader,fragment_shader);
+	}
+	template<class VertexVsIn,class IndexType,class VertShader,class FragShader>
+	void draw(const VertexVsIn* vertexbuffer_b,const VertexVsIn* vertexbuffer_e,
+		const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		VertShader vertex_shader,FragShader fragment_shader)
+	{
+		draw(vertexbuffer_b,vertexbuffer_e,PrimitiveAssembler<IndexType>(indexbuffer_b,indexbuffer_e),vertex_shader,fragment_shader);
+	}
+	template<class IndexType,class VertShader,class FragShader>
+	void draw(const VertexArray& vertexarray,const PrimitiveAssembler<IndexType>& primitives,
+		VertShader vertex_shader,FragShader fragment_shader)
+	{
+		detail::ArrayVertices vsrc={vertexarray,vertexarray.num_vertices};
+		record(vsrc,primitives,vertex_shader,fragment_shader);
+	}
+	template<class IndexType,class VertShader,class FragShader>
+	void draw(const VertexArray& vertexarray,const IndexType* indexbuffer_b,const IndexType* indexbuffer_e,
+		VertShader vertex_shader,FragShader fragment_shader)
+	{
+		draw(vertexarray,PrimitiveAssembler<IndexType>(indexbuffer_b,indexbuffer_e),vertex_shader,fragment_shader);
+	}
+	//Appends the draws recorded in another command buffer, like executing a Vulkan secondary command buffer.  Command buffers
+	//don't share anything while recording, so several can be recorded at once on different threads and then appended to one
+	//buffer in a fixed order, which gives exactly the same image as recording all the draws on one thread in that order.
+	//The draws are copied, each with its own vertex cache, so secondary can be appended several times, to several buffers that execute
+	//at the same time, or to itself, and still be executed on its own.
+	void append(const CommandBuffer& secondary)
+	{
+		std::size_t n=secondary.commands.size();
+		commands.reserve(commands.size()+n);
+		for(std::size_t i=0;i<n;i++)
+		{
+			commands.push_back(std::unique_ptr<Command>(secondary.commands[i]->clone()));
+		}
+	}
+	//The number of recorded draws
+	std::size_t size() const
+	{
+		return commands.size();
+	}
+	//Forgets all the recorded draws.  The bins are kept to be reused by the next execute.
+	void clear()
+	{
+		commands.clear();
+	}
+	//Runs every recorded draw on fb.  The draws stay recorded, so the same commands can be executed again.
+	void execute(Target& fb)
+	{
+		std::size_t n=commands.size();
+		std::vector<std::size_t> first_triangle(n+1,0);
+		std::vector<std::array<std::size_t,3> > jobs;
+		for(std::size_t d=0;d<n;d++)
+		{
+			std::size_t nv=commands[d]->num_vertices();
+			for(std::size_t b=0;b<nv;b+=VERTEX_CHUNK)
+			{
+				jobs.push_back(std::array<std::size_t,3>{{d,b,std::min(b+VERTEX_CHUNK,nv)}});
+			}
+			first_triangle[d+1]=first_triangle[d]+commands[d]->num_triangles();
+		}
+		#pragma omp parallel for schedule(dynamic)
+		for(std::size_t j=0;j<jobs.size();j++)
+		{
+			commands[jobs[j][0]]->shade(jobs[j][1],jobs[j][2]);
+		}
+
+		if(!bins || bins->width != fb.width || bins->height != fb.height)
+		{
+			bins.reset(new TriangleBins(fb.width,fb.height,tile_size,tile_size));
+		}
+		else
+		{
+			bins->clear();
+		}
+		//every triangle of every draw goes into the same bins, numbered in submission order
+		detail::bin_triangles(*bins,first_triangle[n],[&](std::size_t t,Eigen::Array2i& ul,Eigen::Array2i& lr)
+			{
+				std::size_t d=std::upper_bound(first_triangle.begin(),first_triangle.end(),t)-first_triangle.begin()-1;
+				commands[d]->bounds(fb,t-first_triangle[d],ul,lr);
+			});
+
+		#pragma omp parallel for schedule(dynamic)
+		for(std::size_t i=0;i<bins->bins.size();i++)
+		{
+			Eigen::Array2i ul,lr;
+			bins->tile(i,ul,lr);
+			const std::vector<std::size_t>& tris=bins->bins[i];
+			std::size_t d=0;
+			for(std::size_t k=0;k<tris.size();k++)
+			{
+				//the triangle numbers in a bin only increase, so the draw they belong to can be found by walking forward
+				while(tris[k] >= first_triangle[d+1])
+				{
+					d++;
+				}
+				commands[d]->rasterize(fb,tris[k]-first_triangle[d],ul,lr);
+			}
+		}
+	}
+};
 }
 
 #endif
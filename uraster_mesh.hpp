@@ -0,0 +1,1023 @@
+#ifndef URASTER_MESH_HPP
+#define URASTER_MESH_HPP
+
+#include<uraster.hpp>
+#include<cstdint>
+#include<cstddef>
+#include<cstring>
+#include<string>
+#include<vector>
+#include<fstream>
+#include<stdexcept>
+#include<array>
+#include<cmath>
+#include<algorithm>
+#include<unordered_map>
+#include<unordered_set>
+#if defined(__unix__) || defined(__APPLE__)
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+#define URASTER_MESH_MMAP
+#endif
+
+namespace uraster
+{
+
+//This is a compact binary mesh container that can be memory mapped and handed straight to uraster::draw with no parsing or copying.
+//The file is a MeshFileHeader followed by the interleaved vertex array and the index array, each starting on a 64 byte boundary.
+//Everything is little-endian.
+
+//What a vertex attribute is for
+enum class MeshSemantic: uint8_t
+{
+	POSITION,
+	NORMAL,
+	TEXCOORD,
+	COLOR,
+	OTHER
+};
+struct MeshAttribute
+{
+	MeshSemantic semantic;
+	ComponentFormat format;
+	uint8_t components;
+	uint8_t reserved;
+	uint32_t offset;	//byte offset of the attribute inside a vertex
+};
+
+struct MeshFileHeader
+{
+	static const std::size_t MAX_ATTRIBUTES=8;
+	char magic[8];	//"URMESH1"
+	uint32_t num_attributes;
+	uint32_t vertex_stride;	//bytes per vertex
+	uint64_t num_vertices;
+	uint64_t num_indices;
+	uint32_t index_size;	//bytes per index: 2, 4 or 8
+	uint32_t reserved;
+	uint64_t vertex_offset;	//byte offset of the vertex array from the start of the file
+	uint64_t index_offset;	//byte offset of the index array from the start of the file
+	MeshAttribute attributes[MAX_ATTRIBUTES];
+};
+
+//Writes a mesh file.  vertices holds num_vertices vertices of vertex_stride bytes each, laid out as described by attributes.
+inline void write_mesh(const std::string& filename,
+	const void* vertices,std::size_t num_vertices,std::size_t vertex_stride,
+	const std::vector<MeshAttribute>& attributes,
+	const void* indices,std::size_t num_indices,std::size_t index_size)
+{
+	if(attributes.size() > MeshFileHeader::MAX_ATTRIBUTES)
+	{
+		throw std::invalid_argument("uraster::write_mesh: too many vertex attributes");
+	}
+	if(index_size != 2 && index_size != 4 && index_size != 8)
+	{
+		throw std::invalid_argument("uraster::write_mesh: index size must be 2, 4 or 8 bytes");
+	}
+	MeshFileHeader h;
+	std::memset(&h,0,sizeof(h));
+	std::memcpy(h.magic,"URMESH1",8);
+	h.num_attributes=attributes.size();
+	h.vertex_stride=vertex_stride;
+	h.num_vertices=num_vertices;
+	h.num_indices=num_indices;
+	h.index_size=index_size;
+	h.vertex_offset=(sizeof(MeshFileHeader)+63) & ~std::size_t(63);
+	h.index_offset=(h.vertex_offset+num_vertices*vertex_stride+63) & ~std::size_t(63);
+	std::copy(attributes.begin(),attributes.end(),h.attributes);
+
+	std::ofstream out(filename.c_str(),std::ios::binary);
+	if(!out)
+	{
+		throw std::runtime_error("uraster::write_mesh: could not open "+filename);
+	}
+	static const char zeros[64]={0};
+	out.write(reinterpret_cast<const char*>(&h),sizeof(h));
+	out.write(zeros,h.vertex_offset-sizeof(h));
+	out.write(static_cast<const char*>(vertices),num_vertices*vertex_stride);
+	out.write(zeros,h.index_offset-(h.vertex_offset+num_vertices*vertex_stride));
+	out.write(static_cast<const char*>(indices),num_indices*index_size);
+	if(!out)
+	{
+		throw std::runtime_error("uraster::write_mesh: could not write "+filename);
+	}
+}
+
+//This maps a whole file into memory read-only.  On platforms without mmap the file is read into memory instead.
+class MappedFile
+{
+protected:
+	const uint8_t* base;
+	std::size_t length;
+#ifndef URASTER_MESH_MMAP
+	std::vector<uint64_t> buffer;
+#endif
+public:
+	explicit MappedFile(const std::string& filename):
+		base(nullptr),length(0)
+	{
+#ifdef URASTER_MESH_MMAP
+		int fd=open(filename.c_str(),O_RDONLY);
+		if(fd < 0)
+		{
+			throw std::runtime_error("uraster::MappedFile: could not open "+filename);
+		}
+		struct stat st;
+		void* m=MAP_FAILED;
+		if(fstat(fd,&st)==0 && st.st_size > 0)
+		{
+			length=st.st_size;
+			m=mmap(NULL,length,PROT_READ,MAP_PRIVATE,fd,0);
+		}
+		close(fd);
+		if(m==MAP_FAILED)
+		{
+			throw std::runtime_error("uraster::MappedFile: could not map "+filename);
+		}
+		base=static_cast<const uint8_t*>(m);
+#else
+		std::ifstream in(filename.c_str(),std::ios::binary | std::ios::ate);
+		if(!in)
+		{
+			throw std::runtime_error("uraster::MappedFile: could not open "+filename);
+		}
+		length=in.tellg();
+		buffer.resize((length+7)/8);
+		in.seekg(0);
+		in.read(reinterpret_cast<char*>(buffer.data()),length);
+		base=reinterpret_cast<const uint8_t*>(buffer.data());
+#endif
+	}
+	MappedFile(const MappedFile&)=delete;
+	MappedFile& operator=(const MappedFile&)=delete;
+	~MappedFile()
+	{
+#ifdef URASTER_MESH_MMAP
+		if(base)
+		{
+			munmap(const_cast<uint8_t*>(base),length);
+		}
+#endif
+	}
+	const uint8_t* data() const
+	{
+		return base;
+	}
+	std::size_t size() const
+	{
+		return length;
+	}
+};
+
+//This maps a mesh file into memory read-only.  The vertex and index arrays are used in place, so opening even a huge mesh
+//only costs reading the header, and the pages are loaded by the OS as the vertex shader and rasterizer touch them.
+class MappedMesh
+{
+protected:
+	MappedFile file;
+	const uint8_t* base;
+
+	const MeshFileHeader& h() const
+	{
+		return *reinterpret_cast<const MeshFileHeader*>(base);
+	}
+public:
+	explicit MappedMesh(const std::string& filename):
+		file(filename),
+		base(file.data())
+	{
+		std::size_t size=file.size();
+		if(size < sizeof(MeshFileHeader) || std::memcmp(h().magic,"URMESH1",8) != 0)
+		{
+			throw std::runtime_error("uraster::MappedMesh: "+filename+" is not a mesh file");
+		}
+		if(h().num_attributes > MeshFileHeader::MAX_ATTRIBUTES ||
+			h().vertex_offset+h().num_vertices*h().vertex_stride > size ||
+			h().index_offset+h().num_indices*h().index_size > size)
+		{
+			throw std::runtime_error("uraster::MappedMesh: "+filename+" is truncated or corrupt");
+		}
+	}
+	const MeshFileHeader& header() const
+	{
+		return h();
+	}
+	std::size_t num_vertices() const
+	{
+		return h().num_vertices;
+	}
+	std::size_t num_indices() const
+	{
+		return h().num_indices;
+	}
+	//Returns the attribute with the given semantic, or NULL if the mesh doesn't have one
+	const MeshAttribute* attribute(MeshSemantic s) const
+	{
+		for(std::size_t i=0;i<h().num_attributes;i++)
+		{
+			if(h().attributes[i].semantic==s)
+			{
+				return &h().attributes[i];
+			}
+		}
+		return NULL;
+	}
+	//The vertex array viewed as an array of the caller's vertex struct, which must match the stride in the file.
+	template<class VertexType>
+	const VertexType* vertices() const
+	{
+		if(sizeof(VertexType) != h().vertex_stride)
+		{
+			throw std::runtime_error("uraster::MappedMesh: vertex type does not match the vertex stride in the file");
+		}
+		return reinterpret_cast<const VertexType*>(base+h().vertex_offset);
+	}
+	const void* vertex_data() const
+	{
+		return base+h().vertex_offset;
+	}
+	//The vertex attributes as streams that read straight from the mapped file, in the order the header lists them.
+	//This works for any attribute formats, where vertices<VertexType>() needs a struct that matches the file.
+	VertexArray vertex_array() const
+	{
+		VertexArray va(h().num_vertices);
+		for(std::size_t i=0;i<h().num_attributes && i<VertexInput::MAX_ATTRIBUTES;i++)
+		{
+			const MeshAttribute& a=h().attributes[i];
+			va.attribute(i,base+h().vertex_offset+a.offset,a.components,a.format,h().vertex_stride);
+		}
+		return va;
+	}
+	//The index array, which must have been written with indices of this size.
+	template<class IndexType>
+	const IndexType* indices() const
+	{
+		if(sizeof(IndexType) != h().index_size)
+		{
+			throw std::runtime_error("uraster::MappedMesh: index type does not match the index size in the file");
+		}
+		return reinterpret_cast<const IndexType*>(base+h().index_offset);
+	}
+	const void* index_data() const
+	{
+		return base+h().index_offset;
+	}
+};
+
+
+//This is a welded, indexed triangle mesh loaded from a text or scan format, ready for uraster::draw or write_mesh.
+//Vertices are interleaved floats: a position, then a normal and a texture coordinate if the file had them, as described by attributes.
+struct LoadedMesh
+{
+	std::vector<float> vertices;
+	std::size_t stride;	//floats per vertex
+	std::vector<MeshAttribute> attributes;
+	std::vector<uint32_t> indices;
+
+	std::size_t num_vertices() const
+	{
+		return stride ? vertices.size()/stride : 0;
+	}
+	void write(const std::string& filename) const
+	{
+		write_mesh(filename,vertices.data(),num_vertices(),stride*sizeof(float),attributes,indices.data(),indices.size(),sizeof(uint32_t));
+	}
+};
+
+namespace detail
+{
+	//Files are split into chunks of about this many bytes, cut at line starts, which are parsed in parallel.
+	static const std::size_t MESH_CHUNK_BYTES=1 << 22;
+	static const uint32_t NO_INDEX=0xFFFFFFFF;
+
+	inline bool is_space(char c)
+	{
+		return c==' ' || c=='\t' || c=='\r';
+	}
+	inline const char* skip_space(const char* p,const char* e)
+	{
+		while(p < e && is_space(*p)) p++;
+		return p;
+	}
+	inline const char* next_line(const char* p,const char* e)
+	{
+		while(p < e && *p != '\n') p++;
+		return p < e ? p+1 : e;
+	}
+	//A small float parser that stops at e (the mapped file isn't null terminated) and doesn't depend on the locale.
+	inline const char* parse_float(const char* p,const char* e,float& out)
+	{
+		p=skip_space(p,e);
+		bool neg=false;
+		if(p < e && (*p=='-' || *p=='+'))
+		{
+			neg=*p=='-';
+			p++;
+		}
+		double v=0.0;
+		while(p < e && *p >= '0' && *p <= '9')
+		{
+			v=v*10.0+(*p++-'0');
+		}
+		if(p < e && *p=='.')
+		{
+			p++;
+			double scale=0.1;
+			while(p < e && *p >= '0' && *p <= '9')
+			{
+				v+=(*p++-'0')*scale;
+				scale*=0.1;
+			}
+		}
+		if(p < e && (*p=='e' || *p=='E'))
+		{
+			p++;
+			bool eneg=false;
+			if(p < e && (*p=='-' || *p=='+'))
+			{
+				eneg=*p=='-';
+				p++;
+			}
+			int ex=0;
+			while(p < e && *p >= '0' && *p <= '9')
+			{
+				ex=ex*10+(*p++-'0');
+			}
+			v*=std::pow(10.0,eneg ? -ex : ex);
+		}
+		out=static_cast<float>(neg ? -v : v);
+		return p;
+	}
+	inline const char* parse_int(const char* p,const char* e,long long& out,bool& found)
+	{
+		bool neg=false;
+		if(p < e && *p=='-')
+		{
+			neg=true;
+			p++;
+		}
+		found=false;
+		long long v=0;
+		while(p < e && *p >= '0' && *p <= '9')
+		{
+			v=v*10+(*p++-'0');
+			found=true;
+		}
+		out=neg ? -v : v;
+		return p;
+	}
+	//An OBJ index is 1 based, or negative to count back from the last element defined so far.
+	inline uint32_t resolve_obj_index(long long i,std::size_t count)
+	{
+		long long r=i > 0 ? i-1 : static_cast<long long>(count)+i;
+		if(r < 0 || r >= static_cast<long long>(count))
+		{
+			throw std::runtime_error("uraster::load_obj: face index out of range");
+		}
+		return static_cast<uint32_t>(r);
+	}
+
+	inline uint64_t weld_mix(uint64_t h)
+	{
+		h^=h >> 33;
+		h*=0xff51afd7ed558ccdULL;
+		h^=h >> 33;
+		h*=0xc4ceb9fe1a85ec53ULL;
+		h^=h >> 33;
+		return h;
+	}
+	//Hashes n 32 bit words, like the index triples of OBJ corners or the raw bits of a vertex's floats
+	inline uint64_t weld_hash(const uint32_t* k,std::size_t n)
+	{
+		uint64_t h=n;
+		for(std::size_t i=0;i<n;i++)
+		{
+			h=weld_mix(h ^ (k[i]+0x9e3779b97f4a7c15ULL+(h << 6)+(h >> 2)));
+		}
+		return h;
+	}
+
+	//The welder's items are split into this many partitions by hash, and each partition is deduplicated with its own hash set in parallel.
+	//It's a constant so the result doesn't depend on the number of threads.
+	static const std::size_t WELD_PARTITIONS=256;
+
+	//Welds n items, where item i is the nwords 32 bit words at keys+i*key_stride, and items are the same only if all their words are equal.
+	//remap gets the welded vertex of every item and firsts gets the first item of every welded vertex.  Welded vertices are numbered
+	//in the order their first item appears, exactly like a serial pass with one hash map, so the result doesn't depend on the threads either.
+	//The items are counting-sorted into partitions by hash (in order within a partition), every partition finds the first item with each
+	//key, and a prefix sum over the items that are their own first numbers the welded vertices.
+	inline void weld(const uint32_t* keys,std::size_t key_stride,std::size_t nwords,std::size_t n,std::vector<uint32_t>& remap,std::vector<uint32_t>& firsts)
+	{
+		std::vector<uint64_t> hashes(n);
+		std::vector<uint32_t> rep(n);
+		remap.resize(n);
+
+		std::size_t nchunks=n/65536+1;
+		std::vector<std::size_t> offsets(nchunks*WELD_PARTITIONS,0);
+		#pragma omp parallel for
+		for(std::size_t c=0;c<nchunks;c++)
+		{
+			std::size_t* cnt=&offsets[c*WELD_PARTITIONS];
+			for(std::size_t i=c*n/nchunks;i<(c+1)*n/nchunks;i++)
+			{
+				hashes[i]=weld_hash(keys+i*key_stride,nwords);
+				cnt[hashes[i] % WELD_PARTITIONS]++;
+			}
+		}
+		std::vector<std::size_t> partition_begin(WELD_PARTITIONS+1,0);
+		std::size_t total=0;
+		for(std::size_t q=0;q<WELD_PARTITIONS;q++)
+		{
+			partition_begin[q]=total;
+			for(std::size_t c=0;c<nchunks;c++)
+			{
+				std::size_t k=offsets[c*WELD_PARTITIONS+q];
+				offsets[c*WELD_PARTITIONS+q]=total;
+				total+=k;
+			}
+		}
+		partition_begin[WELD_PARTITIONS]=total;
+		std::vector<uint32_t> order(n);
+		#pragma omp parallel for
+		for(std::size_t c=0;c<nchunks;c++)
+		{
+			std::size_t* off=&offsets[c*WELD_PARTITIONS];
+			for(std::size_t i=c*n/nchunks;i<(c+1)*n/nchunks;i++)
+			{
+				order[off[hashes[i] % WELD_PARTITIONS]++]=static_cast<uint32_t>(i);
+			}
+		}
+
+		struct ItemHash
+		{
+			const uint64_t* hashes;
+			std::size_t operator()(uint32_t i) const
+			{
+				return static_cast<std::size_t>(hashes[i] >> 8);
+			}
+		};
+		struct ItemEqual
+		{
+			const uint32_t* keys;
+			std::size_t key_stride;
+			std::size_t nwords;
+			bool operator()(uint32_t a,uint32_t b) const
+			{
+				return std::memcmp(keys+a*key_stride,keys+b*key_stride,nwords*sizeof(uint32_t))==0;
+			}
+		};
+		#pragma omp parallel for schedule(dynamic)
+		for(std::size_t q=0;q<WELD_PARTITIONS;q++)
+		{
+			std::size_t b=partition_begin[q],e=partition_begin[q+1];
+			std::unordered_set<uint32_t,ItemHash,ItemEqual> seen(e-b,ItemHash{hashes.data()},ItemEqual{keys,key_stride,nwords});
+			for(std::size_t k=b;k<e;k++)
+			{
+				rep[order[k]]=*seen.insert(order[k]).first;
+			}
+		}
+
+		std::vector<std::size_t> news(nchunks+1,0);
+		#pragma omp parallel for
+		for(std::size_t c=0;c<nchunks;c++)
+		{
+			for(std::size_t i=c*n/nchunks;i<(c+1)*n/nchunks;i++)
+			{
+				news[c+1]+=rep[i]==i;
+			}
+		}
+		for(std::size_t c=0;c<nchunks;c++)
+		{
+			news[c+1]+=news[c];
+		}
+		firsts.resize(news[nchunks]);
+		#pragma omp parallel for
+		for(std::size_t c=0;c<nchunks;c++)
+		{
+			uint32_t id=static_cast<uint32_t>(news[c]);
+			for(std::size_t i=c*n/nchunks;i<(c+1)*n/nchunks;i++)
+			{
+				if(rep[i]==i)
+				{
+					firsts[id]=static_cast<uint32_t>(i);
+					remap[i]=id++;
+				}
+			}
+		}
+		#pragma omp parallel for
+		for(std::size_t i=0;i<n;i++)
+		{
+			if(rep[i] != i)
+			{
+				remap[i]=remap[rep[i]];
+			}
+		}
+	}
+
+	enum ObjLine { OBJ_OTHER,OBJ_V,OBJ_VT,OBJ_VN,OBJ_F };
+	inline ObjLine obj_line(const char*& p,const char* e)
+	{
+		p=skip_space(p,e);
+		if(e-p < 2) return OBJ_OTHER;
+		if(p[0]=='v')
+		{
+			if(is_space(p[1])) { p+=1; return OBJ_V; }
+			if(e-p > 2 && is_space(p[2]))
+			{
+				if(p[1]=='t') { p+=2; return OBJ_VT; }
+				if(p[1]=='n') { p+=2; return OBJ_VN; }
+			}
+		}
+		else if(p[0]=='f' && is_space(p[1]))
+		{
+			p+=1;
+			return OBJ_F;
+		}
+		return OBJ_OTHER;
+	}
+
+	struct ObjChunk
+	{
+		const char* begin;
+		const char* end;
+		std::size_t counts[3];	//v, vt and vn lines in this chunk
+		std::size_t offsets[3];	//v, vt and vn lines in all the chunks before this one
+		std::vector<float> positions;
+		std::vector<float> texcoords;
+		std::vector<float> normals;
+		std::vector<uint32_t> corners;	//position, texcoord, normal index triples, three corners per triangle
+	};
+	inline void parse_obj_chunk(ObjChunk& c)
+	{
+		std::size_t n[3]={c.offsets[0],c.offsets[1],c.offsets[2]};
+		std::vector<uint32_t> poly;
+		for(const char* p=c.begin;p < c.end;p=next_line(p,c.end))
+		{
+			const char* q=p;
+			float f[3];
+			switch(obj_line(q,c.end))
+			{
+			case OBJ_V:
+				for(int k=0;k<3;k++) q=parse_float(q,c.end,f[k]);
+				c.positions.insert(c.positions.end(),f,f+3);
+				n[0]++;
+				break;
+			case OBJ_VT:
+				for(int k=0;k<2;k++) q=parse_float(q,c.end,f[k]);
+				c.texcoords.insert(c.texcoords.end(),f,f+2);
+				n[1]++;
+				break;
+			case OBJ_VN:
+				for(int k=0;k<3;k++) q=parse_float(q,c.end,f[k]);
+				c.normals.insert(c.normals.end(),f,f+3);
+				n[2]++;
+				break;
+			case OBJ_F:
+				poly.clear();
+				for(q=skip_space(q,c.end);q < c.end && *q != '\n' && *q != '#';q=skip_space(q,c.end))
+				{
+					//v, v/vt, v//vn or v/vt/vn
+					uint32_t corner[3]={NO_INDEX,NO_INDEX,NO_INDEX};
+					for(int k=0;k<3;k++)
+					{
+						long long i;
+						bool found;
+						q=parse_int(q,c.end,i,found);
+						if(found)
+						{
+							corner[k]=resolve_obj_index(i,n[k]);
+						}
+						if(q >= c.end || *q != '/') break;
+						q++;
+					}
+					if(corner[0]==NO_INDEX)
+					{
+						throw std::runtime_error("uraster::load_obj: face is missing a position index");
+					}
+					poly.insert(poly.end(),corner,corner+3);
+					while(q < c.end && !is_space(*q) && *q != '\n') q++;
+				}
+				//polygons are split into a fan of triangles
+				for(std::size_t k=2;k < poly.size()/3;k++)
+				{
+					c.corners.insert(c.corners.end(),poly.begin(),poly.begin()+3);
+					c.corners.insert(c.corners.end(),poly.begin()+3*(k-1),poly.begin()+3*(k+1));
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+//Loads a Wavefront OBJ file.  The file is memory mapped and split into chunks that are parsed in parallel, after a quick parallel pass that counts
+//the v, vt and vn lines in each chunk so every chunk knows how to resolve relative (negative) indices.  Polygons are triangulated as fans.
+//OBJ indexes positions, texture coordinates and normals separately, so every distinct position/texcoord/normal combination becomes one vertex
+//of the welded mesh, numbered in the order the faces first use them.  Welding is done in parallel by hash partitions.
+inline LoadedMesh load_obj(const std::string& filename)
+{
+	using namespace detail;
+	MappedFile file(filename);
+	const char* b=reinterpret_cast<const char*>(file.data());
+	const char* e=b+file.size();
+
+	std::size_t nchunks=file.size()/MESH_CHUNK_BYTES+1;
+	std::vector<ObjChunk> chunks(nchunks);
+	for(std::size_t i=0;i<nchunks;i++)
+	{
+		chunks[i].begin=i==0 ? b : next_line(b+i*file.size()/nchunks-1,e);
+		if(i > 0)
+		{
+			chunks[i-1].end=chunks[i].begin;
+		}
+	}
+	chunks[nchunks-1].end=e;
+
+	#pragma omp parallel for schedule(dynamic)
+	for(std::size_t i=0;i<nchunks;i++)
+	{
+		ObjChunk& c=chunks[i];
+		std::fill(c.counts,c.counts+3,0);
+		for(const char* p=c.begin;p < c.end;p=next_line(p,c.end))
+		{
+			const char* q=p;
+			ObjLine l=obj_line(q,c.end);
+			if(l >= OBJ_V && l <= OBJ_VN)
+			{
+				c.counts[l-OBJ_V]++;
+			}
+		}
+	}
+	std::size_t totals[3]={0,0,0};
+	for(std::size_t i=0;i<nchunks;i++)
+	for(int k=0;k<3;k++)
+	{
+		chunks[i].offsets[k]=totals[k];
+		totals[k]+=chunks[i].counts[k];
+	}
+
+	bool failed=false;
+	std::string error;
+	#pragma omp parallel for schedule(dynamic)
+	for(std::size_t i=0;i<nchunks;i++)
+	{
+		try
+		{
+			parse_obj_chunk(chunks[i]);
+		}
+		catch(const std::exception& ex)
+		{
+			#pragma omp critical
+			{
+				failed=true;
+				error=ex.what();
+			}
+		}
+	}
+	if(failed)
+	{
+		throw std::runtime_error(error);
+	}
+
+	std::vector<float> positions,texcoords,normals;
+	std::vector<std::size_t> corner_offsets(nchunks+1,0);
+	for(std::size_t i=0;i<nchunks;i++)
+	{
+		positions.insert(positions.end(),chunks[i].positions.begin(),chunks[i].positions.end());
+		texcoords.insert(texcoords.end(),chunks[i].texcoords.begin(),chunks[i].texcoords.end());
+		normals.insert(normals.end(),chunks[i].normals.begin(),chunks[i].normals.end());
+		corner_offsets[i+1]=corner_offsets[i]+chunks[i].corners.size();
+	}
+	std::vector<uint32_t> corners(corner_offsets[nchunks]);
+	#pragma omp parallel for
+	for(std::size_t i=0;i<nchunks;i++)
+	{
+		std::copy(chunks[i].corners.begin(),chunks[i].corners.end(),corners.begin()+corner_offsets[i]);
+		std::vector<uint32_t>().swap(chunks[i].corners);
+	}
+
+	//weld every distinct position/texcoord/normal triple into one vertex
+	LoadedMesh mesh;
+	std::vector<uint32_t> firsts;
+	weld(corners.data(),3,3,corners.size()/3,mesh.indices,firsts);
+	std::vector<std::array<uint32_t,3> > welded(firsts.size());
+	#pragma omp parallel for
+	for(std::size_t i=0;i<firsts.size();i++)
+	{
+		std::copy(&corners[3*firsts[i]],&corners[3*firsts[i]]+3,welded[i].begin());
+	}
+	std::vector<uint32_t>().swap(corners);
+
+	bool has_texcoords=false,has_normals=false;
+	for(std::size_t i=0;i<welded.size() && !(has_texcoords && has_normals);i++)
+	{
+		has_texcoords|=welded[i][1] != NO_INDEX;
+		has_normals|=welded[i][2] != NO_INDEX;
+	}
+	mesh.stride=3;
+	mesh.attributes.push_back(MeshAttribute{MeshSemantic::POSITION,ComponentFormat::FLOAT32,3,0,0});
+	if(has_normals)
+	{
+		mesh.attributes.push_back(MeshAttribute{MeshSemantic::NORMAL,ComponentFormat::FLOAT32,3,0,static_cast<uint32_t>(mesh.stride*sizeof(float))});
+		mesh.stride+=3;
+	}
+	if(has_texcoords)
+	{
+		mesh.attributes.push_back(MeshAttribute{MeshSemantic::TEXCOORD,ComponentFormat::FLOAT32,2,0,static_cast<uint32_t>(mesh.stride*sizeof(float))});
+		mesh.stride+=2;
+	}
+	mesh.vertices.resize(welded.size()*mesh.stride);
+	#pragma omp parallel for
+	for(std::size_t i=0;i<welded.size();i++)
+	{
+		float* v=&mesh.vertices[i*mesh.stride];
+		std::copy(&positions[3*welded[i][0]],&positions[3*welded[i][0]]+3,v);
+		v+=3;
+		if(has_normals)
+		{
+			if(welded[i][2] != NO_INDEX) std::copy(&normals[3*welded[i][2]],&normals[3*welded[i][2]]+3,v);
+			else std::fill(v,v+3,0.0f);
+			v+=3;
+		}
+		if(has_texcoords)
+		{
+			if(welded[i][1] != NO_INDEX) std::copy(&texcoords[2*welded[i][1]],&texcoords[2*welded[i][1]]+2,v);
+			else std::fill(v,v+2,0.0f);
+		}
+	}
+	return mesh;
+}
+
+namespace detail
+{
+	struct PlyProperty
+	{
+		std::string name;
+		int type;	//byte size of a scalar, negative for signed integers, 0x40|size for floating point
+		int count_type;	//for lists, the type of the element count.  0 for scalars
+	};
+	struct PlyElement
+	{
+		std::string name;
+		std::size_t count;
+		std::vector<PlyProperty> properties;
+	};
+	inline int ply_type(const std::string& t)
+	{
+		if(t=="char" || t=="int8") return -1;
+		if(t=="uchar" || t=="uint8") return 1;
+		if(t=="short" || t=="int16") return -2;
+		if(t=="ushort" || t=="uint16") return 2;
+		if(t=="int" || t=="int32") return -4;
+		if(t=="uint" || t=="uint32") return 4;
+		if(t=="float" || t=="float32") return 0x44;
+		if(t=="double" || t=="float64") return 0x48;
+		throw std::runtime_error("uraster::load_ply: unknown property type "+t);
+	}
+	inline std::size_t ply_size(int type)
+	{
+		return (type < 0 ? -type : type) & 0xF;
+	}
+	inline double ply_read(const uint8_t* p,int type,bool swap)
+	{
+		uint8_t b[8];
+		std::size_t n=ply_size(type);
+		for(std::size_t i=0;i<n;i++) b[i]=p[swap ? n-1-i : i];
+		switch(type)
+		{
+		case -1: { int8_t v; std::memcpy(&v,b,1); return v; }
+		case 1: return b[0];
+		case -2: { int16_t v; std::memcpy(&v,b,2); return v; }
+		case 2: { uint16_t v; std::memcpy(&v,b,2); return v; }
+		case -4: { int32_t v; std::memcpy(&v,b,4); return v; }
+		case 4: { uint32_t v; std::memcpy(&v,b,4); return v; }
+		case 0x44: { float v; std::memcpy(&v,b,4); return v; }
+		default: { double v; std::memcpy(&v,b,8); return v; }
+		}
+	}
+	inline bool host_big_endian()
+	{
+		const uint16_t one=1;
+		return *reinterpret_cast<const uint8_t*>(&one)==0;
+	}
+}
+
+//Loads a binary (little or big endian) PLY file.  The vertex element is decoded in parallel straight from the mapped file; x/y/z are
+//required and nx/ny/nz and u/v (or s/t) are kept if present.  Faces are read from the vertex_indices list and triangulated as fans.
+//Scans often come with vertices split or duplicated per face, so vertices with identical attributes are welded into one, numbered in the order
+//they first appear in the file.  -0.0 and 0.0 are treated as the same value.
+inline LoadedMesh load_ply(const std::string& filename)
+{
+	using namespace detail;
+	MappedFile file(filename);
+	const char* b=reinterpret_cast<const char*>(file.data());
+	const char* e=b+file.size();
+
+	//the header is ascii, one statement per line, up to end_header
+	std::vector<PlyElement> elements;
+	bool swap=false;
+	const char* p=b;
+	if(e-b < 4 || std::memcmp(b,"ply",3) != 0)
+	{
+		throw std::runtime_error("uraster::load_ply: "+filename+" is not a PLY file");
+	}
+	for(p=next_line(p,e);;p=next_line(p,e))
+	{
+		if(p >= e)
+		{
+			throw std::runtime_error("uraster::load_ply: "+filename+" has no end_header");
+		}
+		const char* le=next_line(p,e);
+		std::vector<std::string> words;
+		for(const char* q=skip_space(p,le);q < le && *q != '\n';q=skip_space(q,le))
+		{
+			const char* w=q;
+			while(q < le && !is_space(*q) && *q != '\n') q++;
+			words.push_back(std::string(w,q));
+		}
+		if(words.empty() || words[0]=="comment" || words[0]=="obj_info") continue;
+		if(words[0]=="end_header")
+		{
+			p=le;
+			break;
+		}
+		if(words[0]=="format" && words.size() > 1)
+		{
+			if(words[1]=="ascii") throw std::runtime_error("uraster::load_ply: only binary PLY files are supported");
+			swap=(words[1]=="binary_big_endian") != host_big_endian();
+		}
+		else if(words[0]=="element" && words.size()==3)
+		{
+			PlyElement el;
+			el.name=words[1];
+			el.count=std::stoull(words[2]);
+			elements.push_back(el);
+		}
+		else if(words[0]=="property" && !elements.empty())
+		{
+			PlyProperty pr;
+			if(words.size()==5 && words[1]=="list")
+			{
+				pr.count_type=ply_type(words[2]);
+				pr.type=ply_type(words[3]);
+				pr.name=words[4];
+			}
+			else if(words.size()==3)
+			{
+				pr.count_type=0;
+				pr.type=ply_type(words[1]);
+				pr.name=words[2];
+			}
+			else throw std::runtime_error("uraster::load_ply: bad property line");
+			elements.back().properties.push_back(pr);
+		}
+	}
+
+	LoadedMesh mesh;
+	const uint8_t* data=reinterpret_cast<const uint8_t*>(p);
+	const uint8_t* data_end=reinterpret_cast<const uint8_t*>(e);
+	bool have_vertices=false;
+	for(std::size_t ei=0;ei<elements.size();ei++)
+	{
+		const PlyElement& el=elements[ei];
+		if(el.name=="vertex")
+		{
+			//vertex records are fixed size, so every vertex can be decoded independently
+			std::size_t record=0;
+			int slot[8];	//x y z nx ny nz u v property index, or -1
+			std::fill(slot,slot+8,-1);
+			std::vector<std::size_t> offset(el.properties.size());
+			static const char* names[8][3]={{"x",0,0},{"y",0,0},{"z",0,0},{"nx",0,0},{"ny",0,0},{"nz",0,0},{"u","s","texture_u"},{"v","t","texture_v"}};
+			for(std::size_t pi=0;pi<el.properties.size();pi++)
+			{
+				const PlyProperty& pr=el.properties[pi];
+				if(pr.count_type) throw std::runtime_error("uraster::load_ply: list properties on vertices are not supported");
+				offset[pi]=record;
+				record+=ply_size(pr.type);
+				for(int k=0;k<8;k++)
+				for(int a=0;a<3;a++)
+				{
+					if(names[k][a] && pr.name==names[k][a]) slot[k]=pi;
+				}
+			}
+			if(slot[0] < 0 || slot[1] < 0 || slot[2] < 0)
+			{
+				throw std::runtime_error("uraster::load_ply: vertices need x, y and z");
+			}
+			if(data+record*el.count > data_end)
+			{
+				throw std::runtime_error("uraster::load_ply: "+filename+" is truncated");
+			}
+			bool has_normals=slot[3] >= 0 && slot[4] >= 0 && slot[5] >= 0;
+			bool has_texcoords=slot[6] >= 0 && slot[7] >= 0;
+			mesh.stride=3;
+			mesh.attributes.push_back(MeshAttribute{MeshSemantic::POSITION,ComponentFormat::FLOAT32,3,0,0});
+			if(has_normals)
+			{
+				mesh.attributes.push_back(MeshAttribute{MeshSemantic::NORMAL,ComponentFormat::FLOAT32,3,0,static_cast<uint32_t>(mesh.stride*sizeof(float))});
+				mesh.stride+=3;
+			}
+			if(has_texcoords)
+			{
+				mesh.attributes.push_back(MeshAttribute{MeshSemantic::TEXCOORD,ComponentFormat::FLOAT32,2,0,static_cast<uint32_t>(mesh.stride*sizeof(float))});
+				mesh.stride+=2;
+			}
+			std::vector<int> used;
+			for(int k=0;k<8;k++)
+			{
+				if(k < 3 || (k < 6 && has_normals) || (k >= 6 && has_texcoords)) used.push_back(slot[k]);
+			}
+			mesh.vertices.resize(el.count*mesh.stride);
+			#pragma omp parallel for
+			for(std::size_t i=0;i<el.count;i++)
+			{
+				const uint8_t* r=data+i*record;
+				float* v=&mesh.vertices[i*mesh.stride];
+				for(std::size_t k=0;k<used.size();k++)
+				{
+					v[k]=static_cast<float>(ply_read(r+offset[used[k]],el.properties[used[k]].type,swap));
+				}
+			}
+			data+=record*el.count;
+			have_vertices=true;
+		}
+		else
+		{
+			//faces and any other elements can have lists, so they are walked in order
+			bool faces=el.name=="face";
+			if(faces) mesh.indices.reserve(el.count*3);
+			std::vector<uint32_t> poly;
+			for(std::size_t i=0;i<el.count;i++)
+			for(std::size_t pi=0;pi<el.properties.size();pi++)
+			{
+				const PlyProperty& pr=el.properties[pi];
+				std::size_t n=1;
+				if(pr.count_type)
+				{
+					if(data+ply_size(pr.count_type) > data_end) throw std::runtime_error("uraster::load_ply: "+filename+" is truncated");
+					n=static_cast<std::size_t>(ply_read(data,pr.count_type,swap));
+					data+=ply_size(pr.count_type);
+				}
+				if(data+n*ply_size(pr.type) > data_end) throw std::runtime_error("uraster::load_ply: "+filename+" is truncated");
+				if(faces && pr.count_type && (pr.name=="vertex_indices" || pr.name=="vertex_index"))
+				{
+					poly.resize(n);
+					for(std::size_t k=0;k<n;k++)
+					{
+						poly[k]=static_cast<uint32_t>(ply_read(data+k*ply_size(pr.type),pr.type,swap));
+					}
+					for(std::size_t k=2;k<n;k++)
+					{
+						mesh.indices.push_back(poly[0]);
+						mesh.indices.push_back(poly[k-1]);
+						mesh.indices.push_back(poly[k]);
+					}
+				}
+				data+=n*ply_size(pr.type);
+			}
+		}
+	}
+	if(!have_vertices)
+	{
+		throw std::runtime_error("uraster::load_ply: "+filename+" has no vertex element");
+	}
+	for(std::size_t i=0;i<mesh.indices.size();i++)
+	{
+		if(mesh.indices[i] >= mesh.num_vertices()) throw std::runtime_error("uraster::load_ply: face index out of range");
+	}
+
+	//weld vertices whose attributes have the same bits
+	std::vector<uint32_t> bits(mesh.vertices.size());
+	std::memcpy(bits.data(),mesh.vertices.data(),bits.size()*sizeof(uint32_t));
+	#pragma omp parallel for
+	for(std::size_t i=0;i<bits.size();i++)
+	{
+		if(bits[i]==0x80000000u) bits[i]=0;
+	}
+	std::vector<uint32_t> remap,firsts;
+	weld(bits.data(),mesh.stride,mesh.stride,mesh.num_vertices(),remap,firsts);
+	std::vector<uint32_t>().swap(bits);
+	if(firsts.size() < mesh.num_vertices())
+	{
+		std::vector<float> welded(firsts.size()*mesh.stride);
+		#pragma omp parallel for
+		for(std::size_t i=0;i<firsts.size();i++)
+		{
+			std::copy(&mesh.vertices[firsts[i]*mesh.stride],&mesh.vertices[firsts[i]*mesh.stride]+mesh.stride,&welded[i*mesh.stride]);
+		}
+		mesh.vertices.swap(welded);
+		#pragma omp parallel for
+		for(std::size_t i=0;i<mesh.indices.size();i++)
+		{
+			mesh.indices[i]=remap[mesh.indices[i]];
+		}
+	}
+	return mesh;
+}
+
+}
+
+#endif
@@ -0,0 +1,632 @@
+#ifndef URASTER_TEXTURE_HPP
+#define URASTER_TEXTURE_HPP
+
+#include<Eigen/Dense>
+#include<vector>
+#include<cstdint>
+#include<cstddef>
+#include<cmath>
+#include<algorithm>
+#include<atomic>
+
+namespace uraster
+{
+
+//What happens to texture coordinates outside of [0,1).  REPEAT tiles the texture, CLAMP smears the edge texels.
+enum class TextureWrap
+{
+	REPEAT,
+	CLAMP
+};
+
+//Converts a stored channel value to the float the sampler works in and back.
+//Integer channels are treated as normalized (like GL_UNORM) so 255 in a uint8_t texture samples as 1.0f.  Floats are passed through.
+template<class T>
+struct TexelTraits
+{
+	static float to_float(T t) { return static_cast<float>(t); }
+	static T from_float(float f) { return static_cast<T>(f); }
+};
+template<>
+struct TexelTraits<uint8_t>
+{
+	static float to_float(uint8_t t) { return t*(1.0f/255.0f); }
+	static uint8_t from_float(float f) { return static_cast<uint8_t>(std::max(0.0f,std::min(f*255.0f+0.5f,255.0f))); }
+};
+template<>
+struct TexelTraits<uint16_t>
+{
+	static float to_float(uint16_t t) { return t*(1.0f/65535.0f); }
+	static uint16_t from_float(float f) { return static_cast<uint16_t>(std::max(0.0f,std::min(f*65535.0f+0.5f,65535.0f))); }
+};
+
+//Dimensions of one mip level and where it starts in a texture's storage
+struct TextureLevel
+{
+	std::size_t width;
+	std::size_t height;
+	std::size_t tiles_x;
+	std::size_t offset;	//offset into the texture's storage, in texels or blocks
+};
+
+//This holds the mip chain bookkeeping and does all of the filtering math for the texture classes below.
+//Derived must provide fetch_texel(const Level&,x,y) that returns the decoded texel at integer coordinates.
+//Texture coordinates are normalized: (0,0) is the upper-left corner of the image and (1,1) is the lower right, like OpenGL.
+template<class Derived,int Channels>
+class TextureSampler
+{
+public:
+	typedef Eigen::Array<float,Channels,1> Sample;
+	typedef TextureLevel Level;
+	static const std::size_t TILE=4;
+
+	TextureWrap wrap;
+protected:
+	std::vector<Level> levels;
+
+	TextureSampler(TextureWrap wrp):
+		wrap(wrp)
+	{}
+	const Derived& derived() const
+	{
+		return static_cast<const Derived&>(*this);
+	}
+	std::size_t wrap_coord(int i,std::size_t n) const
+	{
+		if(wrap==TextureWrap::REPEAT)
+		{
+			int r=i % static_cast<int>(n);
+			return r < 0 ? r+n : r;
+		}
+		return std::min(static_cast<std::size_t>(std::max(i,0)),n-1);
+	}
+	std::size_t nearest_level(float lod) const
+	{
+		float l=std::floor(lod+0.5f);
+		return l <= 0.0f ? 0 : std::min(static_cast<std::size_t>(l),levels.size()-1);
+	}
+	//Appends the metadata for the next level and returns the number of 4x4 tiles it needs.
+	std::size_t push_level(std::size_t w,std::size_t h,std::size_t offset)
+	{
+		Level l;
+		l.width=w;
+		l.height=h;
+		l.tiles_x=(w+TILE-1)/TILE;
+		l.offset=offset;
+		levels.push_back(l);
+		return l.tiles_x*((h+TILE-1)/TILE);
+	}
+	Sample bilinear(const Level& l,float u,float v) const
+	{
+		float tx=u*l.width-0.5f;
+		float ty=v*l.height-0.5f;
+		float fx=std::floor(tx),fy=std::floor(ty);
+		return bilinear(l,static_cast<int>(fx),static_cast<int>(fy),tx-fx,ty-fy);
+	}
+	Sample bilinear(const Level& l,int x,int y,float wx,float wy) const
+	{
+		std::size_t x0=wrap_coord(x,l.width),x1=wrap_coord(x+1,l.width);
+		std::size_t y0=wrap_coord(y,l.height),y1=wrap_coord(y+1,l.height);
+		const Derived& d=derived();
+		Sample top=d.fetch_texel(l,x0,y0)*(1.0f-wx)+d.fetch_texel(l,x1,y0)*wx;
+		Sample bot=d.fetch_texel(l,x0,y1)*(1.0f-wx)+d.fetch_texel(l,x1,y1)*wx;
+		return top*(1.0f-wy)+bot*wy;
+	}
+public:
+	std::size_t num_levels() const
+	{
+		return levels.size();
+	}
+	const Level& level(std::size_t i) const
+	{
+		return levels[i];
+	}
+	std::size_t width() const { return levels[0].width; }
+	std::size_t height() const { return levels[0].height; }
+
+	//Returns the level of detail at which one screen pixel covers one texel, given how many level 0 texels a pixel spans.
+	static float lod(float texels_per_pixel)
+	{
+		return std::log2(std::max(texels_per_pixel,1.0f));
+	}
+
+	//Unfiltered texel at integer coordinates of a mip level
+	Sample texel(std::size_t level,std::size_t x,std::size_t y) const
+	{
+		return derived().fetch_texel(levels[level],x,y);
+	}
+	//Point sampling from the mip level nearest to lod
+	Sample sample_nearest(float u,float v,float lod=0.0f) const
+	{
+		const Level& l=levels[nearest_level(lod)];
+		std::size_t x=wrap_coord(static_cast<int>(std::floor(u*l.width)),l.width);
+		std::size_t y=wrap_coord(static_cast<int>(std::floor(v*l.height)),l.height);
+		return derived().fetch_texel(l,x,y);
+	}
+	//Bilinear filtering from the mip level nearest to lod
+	Sample sample_bilinear(float u,float v,float lod=0.0f) const
+	{
+		return bilinear(levels[nearest_level(lod)],u,v);
+	}
+	//Bilinear filtering from the two mip levels around lod, blended linearly.
+	Sample sample_trilinear(float u,float v,float lod) const
+	{
+		float maxlod=static_cast<float>(levels.size()-1);
+		lod=std::max(0.0f,std::min(lod,maxlod));
+		std::size_t l0=static_cast<std::size_t>(lod);
+		std::size_t l1=std::min(l0+1,levels.size()-1);
+		float f=lod-l0;
+		Sample s=bilinear(levels[l0],u,v);
+		if(f > 0.0f)
+		{
+			s+=(bilinear(levels[l1],u,v)-s)*f;
+		}
+		return s;
+	}
+
+	//Batched bilinear sampling of n coordinates from one mip level into out, which holds n*Channels floats interleaved.
+	//This works 8 lanes at a time in SoA form: the coordinate math is vectorized, the four taps of every lane are gathered
+	//into one column per channel, and then the lerps run across all 8 lanes at once.  Only the gather itself is scalar,
+	//since the texel address and decode depend on the texture's storage.
+	void sample_bilinear(const float* u,const float* v,std::size_t n,float* out,float lod=0.0f) const
+	{
+		typedef Eigen::Array<float,8,1> Lanes;
+		typedef Eigen::Array<float,8,Channels> LaneSamples;
+		const Level& l=levels[nearest_level(lod)];
+		const Derived& d=derived();
+		for(std::size_t i=0;i<n;i+=8)
+		{
+			std::size_t m=std::min<std::size_t>(8,n-i);
+			Lanes lu=Lanes::Zero(),lv=Lanes::Zero();
+			std::copy(u+i,u+i+m,lu.data());
+			std::copy(v+i,v+i+m,lv.data());
+			Lanes tx=lu*static_cast<float>(l.width)-0.5f;
+			Lanes ty=lv*static_cast<float>(l.height)-0.5f;
+			Lanes fx=tx.floor(),fy=ty.floor();
+			Lanes wx=tx-fx,wy=ty-fy;
+
+			LaneSamples t00=LaneSamples::Zero(),t10=LaneSamples::Zero(),t01=LaneSamples::Zero(),t11=LaneSamples::Zero();
+			for(std::size_t k=0;k<m;k++)
+			{
+				int x=static_cast<int>(fx[k]),y=static_cast<int>(fy[k]);
+				std::size_t x0=wrap_coord(x,l.width),x1=wrap_coord(x+1,l.width);
+				std::size_t y0=wrap_coord(y,l.height),y1=wrap_coord(y+1,l.height);
+				t00.row(k)=d.fetch_texel(l,x0,y0).transpose();
+				t10.row(k)=d.fetch_texel(l,x1,y0).transpose();
+				t01.row(k)=d.fetch_texel(l,x0,y1).transpose();
+				t11.row(k)=d.fetch_texel(l,x1,y1).transpose();
+			}
+			Lanes iwx=1.0f-wx,iwy=1.0f-wy;
+			LaneSamples top=t00.colwise()*iwx+t10.colwise()*wx;
+			LaneSamples bot=t01.colwise()*iwx+t11.colwise()*wx;
+			LaneSamples s=top.colwise()*iwy+bot.colwise()*wy;
+			Eigen::Map<Eigen::Array<float,Channels,Eigen::Dynamic>>(out+i*Channels,Channels,m)=s.topRows(m).transpose();
+		}
+	}
+};
+
+//This is a mipmapped texture with Channels channels of type T per texel.
+//Each mip level is stored in 4x4 texel tiles, with each tile contiguous in memory.  A 2x2 bilinear footprint almost always lands in one tile,
+//so a sample touches one or two cache lines instead of two rows that are a whole image width apart.
+template<class T,int Channels>
+class Texture: public TextureSampler<Texture<T,Channels>,Channels>
+{
+	friend class TextureSampler<Texture<T,Channels>,Channels>;
+public:
+	typedef TextureSampler<Texture<T,Channels>,Channels> Base;
+	typedef typename Base::Sample Sample;
+	typedef typename Base::Level Level;
+	using Base::TILE;
+protected:
+	using Base::levels;
+	std::vector<T> data;
+
+	//The tiled address splits into a part that only depends on x and a part that only depends on y
+	static std::size_t xoffset(std::size_t x)
+	{
+		return (x/TILE)*TILE*TILE+(x%TILE);
+	}
+	static std::size_t yoffset(const Level& l,std::size_t y)
+	{
+		return (y/TILE)*l.tiles_x*TILE*TILE+(y%TILE)*TILE;
+	}
+	Sample fetch_texel(const Level& l,std::size_t x,std::size_t y) const
+	{
+		const T* t=&data[(l.offset+yoffset(l,y)+xoffset(x))*Channels];
+		Sample s;
+		for(int c=0;c<Channels;c++)
+		{
+			s[c]=TexelTraits<T>::to_float(t[c]);
+		}
+		return s;
+	}
+	std::size_t add_level(std::size_t w,std::size_t h)
+	{
+		std::size_t ntiles=this->push_level(w,h,data.size()/Channels);
+		data.resize(data.size()+ntiles*TILE*TILE*Channels);
+		return levels.size()-1;
+	}
+	T& at(std::size_t level,std::size_t x,std::size_t y,int c)
+	{
+		const Level& l=levels[level];
+		return data[(l.offset+yoffset(l,y)+xoffset(x))*Channels+c];
+	}
+	//Box-filter level-1 down into level.  Odd dimensions clamp to the last row/column.
+	void downsample(std::size_t level)
+	{
+		const Level& src=levels[level-1];
+		const Level& dst=levels[level];
+		#pragma omp parallel for
+		for(std::size_t y=0;y<dst.height;y++)
+		for(std::size_t x=0;x<dst.width;x++)
+		{
+			std::size_t x0=std::min(2*x,src.width-1),x1=std::min(2*x+1,src.width-1);
+			std::size_t y0=std::min(2*y,src.height-1),y1=std::min(2*y+1,src.height-1);
+			Sample s=fetch_texel(src,x0,y0)+fetch_texel(src,x1,y0)+fetch_texel(src,x0,y1)+fetch_texel(src,x1,y1);
+			s*=0.25f;
+			for(int c=0;c<Channels;c++)
+			{
+				at(level,x,y,c)=TexelTraits<T>::from_float(s[c]);
+			}
+		}
+	}
+public:
+	//Builds a texture from an arbitrarily strided source image.  Strides are in elements of T, so
+	//interleaved RGB is (3,3*w,1) and a planar image (like CImg) is (1,w,w*h).
+	//If mipmaps is true the full mip chain down to 1x1 is generated with a box filter.
+	Texture(std::size_t w,std::size_t h,const T* src,
+		std::ptrdiff_t xstride,std::ptrdiff_t ystride,std::ptrdiff_t cstride,
+		bool mipmaps=true,TextureWrap wrp=TextureWrap::REPEAT):
+		Base(wrp)
+	{
+		add_level(w,h);
+		#pragma omp parallel for
+		for(std::size_t y=0;y<h;y++)
+		for(std::size_t x=0;x<w;x++)
+		for(int c=0;c<Channels;c++)
+		{
+			at(0,x,y,c)=src[x*xstride+y*ystride+c*cstride];
+		}
+		while(mipmaps && (w > 1 || h > 1))
+		{
+			w=std::max<std::size_t>(w/2,1);
+			h=std::max<std::size_t>(h/2,1);
+			downsample(add_level(w,h));
+		}
+	}
+	//interleaved version
+	Texture(std::size_t w,std::size_t h,const T* src,bool mipmaps=true,TextureWrap wrp=TextureWrap::REPEAT):
+		Texture(w,h,src,Channels,Channels*w,1,mipmaps,wrp)
+	{}
+};
+
+//Block compression formats.  Each one describes how a 4x4 texel block is packed into BlockBytes bytes, and
+//can decode a block to 16 interleaved 8 bit texels or encode 16 float texels (in [0,1]) into a block.
+//These are bit-compatible with the BC1 (DXT1), BC4 and BC5 formats used by GPUs, so data from offline tools can be loaded directly.
+namespace detail
+{
+	inline uint16_t pack565(const float* c)
+	{
+		int r=static_cast<int>(std::max(0.0f,std::min(c[0],1.0f))*31.0f+0.5f);
+		int g=static_cast<int>(std::max(0.0f,std::min(c[1],1.0f))*63.0f+0.5f);
+		int b=static_cast<int>(std::max(0.0f,std::min(c[2],1.0f))*31.0f+0.5f);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+	inline void unpack565(uint16_t v,int* c)
+	{
+		int r=(v >> 11) & 31,g=(v >> 5) & 63,b=v & 31;
+		c[0]=(r << 3) | (r >> 2);
+		c[1]=(g << 2) | (g >> 4);
+		c[2]=(b << 3) | (b >> 2);
+	}
+	//BC4 stores one channel as two 8 bit endpoints and 16 3-bit indices into an 8 entry palette.
+	inline void decode_bc4(const uint8_t* block,uint8_t* out,int stride)
+	{
+		int pal[8];
+		pal[0]=block[0];
+		pal[1]=block[1];
+		if(pal[0] > pal[1])
+		{
+			for(int i=1;i<7;i++) pal[i+1]=((7-i)*pal[0]+i*pal[1]+3)/7;
+		}
+		else
+		{
+			for(int i=1;i<5;i++) pal[i+1]=((5-i)*pal[0]+i*pal[1]+2)/5;
+			pal[6]=0;
+			pal[7]=255;
+		}
+		uint64_t bits=0;
+		for(int i=0;i<6;i++) bits|=static_cast<uint64_t>(block[2+i]) << (8*i);
+		for(int i=0;i<16;i++)
+		{
+			out[i*stride]=static_cast<uint8_t>(pal[(bits >> (3*i)) & 7]);
+		}
+	}
+	inline void encode_bc4(const float* texels,int stride,uint8_t* block)
+	{
+		float lo=1.0f,hi=0.0f;
+		for(int i=0;i<16;i++)
+		{
+			float t=std::max(0.0f,std::min(texels[i*stride],1.0f));
+			lo=std::min(lo,t);
+			hi=std::max(hi,t);
+		}
+		int e0=static_cast<int>(hi*255.0f+0.5f),e1=static_cast<int>(lo*255.0f+0.5f);
+		block[0]=static_cast<uint8_t>(e0);
+		block[1]=static_cast<uint8_t>(e1);
+		uint64_t bits=0;
+		if(e0 > e1)
+		{
+			//palette index 0 is e0, 1 is e1 and 2..7 step from e0 toward e1
+			static const int order[8]={0,2,3,4,5,6,7,1};
+			for(int i=0;i<16;i++)
+			{
+				float t=std::max(0.0f,std::min(texels[i*stride],1.0f))*255.0f;
+				int step=static_cast<int>((e0-t)*7.0f/(e0-e1)+0.5f);
+				step=std::max(0,std::min(step,7));
+				bits|=static_cast<uint64_t>(order[step]) << (3*i);
+			}
+		}
+		for(int i=0;i<6;i++) block[2+i]=static_cast<uint8_t>(bits >> (8*i));
+	}
+}
+
+struct BC1
+{
+	static const int Channels=3;
+	static const std::size_t BlockBytes=8;
+	static void decode(const uint8_t* block,uint8_t* out)
+	{
+		uint16_t c0=block[0] | (block[1] << 8),c1=block[2] | (block[3] << 8);
+		int pal[4][3];
+		detail::unpack565(c0,pal[0]);
+		detail::unpack565(c1,pal[1]);
+		for(int c=0;c<3;c++)
+		{
+			if(c0 > c1)
+			{
+				pal[2][c]=(2*pal[0][c]+pal[1][c]+1)/3;
+				pal[3][c]=(pal[0][c]+2*pal[1][c]+1)/3;
+			}
+			else
+			{
+				pal[2][c]=(pal[0][c]+pal[1][c])/2;
+				pal[3][c]=0;
+			}
+		}
+		uint32_t bits=block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+		for(int i=0;i<16;i++)
+		{
+			const int* p=pal[(bits >> (2*i)) & 3];
+			for(int c=0;c<3;c++) out[3*i+c]=static_cast<uint8_t>(p[c]);
+		}
+	}
+	//Bounding box encoder: the endpoints are opposite corners of the texels' color box pulled in by 1/16 of the range, then each texel picks the closest palette entry.
+	static void encode(const float* texels,uint8_t* block)
+	{
+		float lo[3]={1.0f,1.0f,1.0f},hi[3]={0.0f,0.0f,0.0f};
+		for(int i=0;i<16;i++)
+		for(int c=0;c<3;c++)
+		{
+			lo[c]=std::min(lo[c],texels[3*i+c]);
+			hi[c]=std::max(hi[c],texels[3*i+c]);
+		}
+		//the box has four diagonals.  Pick the one the texels actually lie along by flipping red and blue when they fall as green rises.
+		float mean[3]={0.0f,0.0f,0.0f},cov[3]={0.0f,0.0f,0.0f};
+		for(int i=0;i<16;i++)
+		for(int c=0;c<3;c++)
+		{
+			mean[c]+=texels[3*i+c]/16.0f;
+		}
+		for(int i=0;i<16;i++)
+		for(int c=0;c<3;c+=2)
+		{
+			cov[c]+=(texels[3*i+c]-mean[c])*(texels[3*i+1]-mean[1]);
+		}
+		for(int c=0;c<3;c+=2)
+		{
+			if(cov[c] < 0.0f)
+			{
+				std::swap(lo[c],hi[c]);
+			}
+		}
+		for(int c=0;c<3;c++)
+		{
+			float inset=(hi[c]-lo[c])/16.0f;
+			lo[c]+=inset;
+			hi[c]-=inset;
+		}
+		uint16_t c0=detail::pack565(hi),c1=detail::pack565(lo);
+		uint32_t bits=0;
+		if(c0 < c1)
+		{
+			std::swap(c0,c1);
+		}
+		if(c0 != c1)
+		{
+			int pal[4][3];
+			detail::unpack565(c0,pal[0]);
+			detail::unpack565(c1,pal[1]);
+			for(int c=0;c<3;c++)
+			{
+				pal[2][c]=(2*pal[0][c]+pal[1][c]+1)/3;
+				pal[3][c]=(pal[0][c]+2*pal[1][c]+1)/3;
+			}
+			for(int i=0;i<16;i++)
+			{
+				float best=1e30f;
+				uint32_t bi=0;
+				for(uint32_t p=0;p<4;p++)
+				{
+					float d=0.0f;
+					for(int c=0;c<3;c++)
+					{
+						float e=texels[3*i+c]*255.0f-pal[p][c];
+						d+=e*e;
+					}
+					if(d < best)
+					{
+						best=d;
+						bi=p;
+					}
+				}
+				bits|=bi << (2*i);
+			}
+		}
+		block[0]=c0 & 0xFF; block[1]=c0 >> 8;
+		block[2]=c1 & 0xFF; block[3]=c1 >> 8;
+		for(int i=0;i<4;i++) block[4+i]=static_cast<uint8_t>(bits >> (8*i));
+	}
+};
+struct BC4
+{
+	static const int Channels=1;
+	static const std::size_t BlockBytes=8;
+	static void decode(const uint8_t* block,uint8_t* out) { detail::decode_bc4(block,out,1); }
+	static void encode(const float* texels,uint8_t* block) { detail::encode_bc4(texels,1,block); }
+};
+struct BC5
+{
+	static const int Channels=2;
+	static const std::size_t BlockBytes=16;
+	static void decode(const uint8_t* block,uint8_t* out)
+	{
+		detail::decode_bc4(block,out,2);
+		detail::decode_bc4(block+8,out+1,2);
+	}
+	static void encode(const float* texels,uint8_t* block)
+	{
+		detail::encode_bc4(texels,2,block);
+		detail::encode_bc4(texels+1,2,block+8);
+	}
+};
+
+//This is a mipmapped texture whose levels are kept block compressed in Format (BC1, BC4 or BC5), so it uses 4-8x less memory than
+//the equivalent uint8_t Texture.  Blocks are decoded on demand as the sampler touches them, through a small direct-mapped cache of decoded blocks
+//that each thread keeps for itself, so the bilinear footprints of neighboring fragments mostly hit already decoded texels.
+template<class Format>
+class CompressedTexture: public TextureSampler<CompressedTexture<Format>,Format::Channels>
+{
+	friend class TextureSampler<CompressedTexture<Format>,Format::Channels>;
+public:
+	static const int Channels=Format::Channels;
+	typedef TextureSampler<CompressedTexture<Format>,Channels> Base;
+	typedef typename Base::Sample Sample;
+	typedef typename Base::Level Level;
+	using Base::TILE;
+protected:
+	using Base::levels;
+	std::vector<uint8_t> blocks;
+	std::size_t id;	//distinguishes this texture's blocks from other textures' in the decode cache
+
+	struct BlockCache
+	{
+		static const std::size_t SIZE=64;	//8x8 blocks
+		std::size_t ids[SIZE];
+		std::size_t keys[SIZE];
+		uint8_t texels[SIZE][16*Channels];
+	};
+	static std::size_t next_id()
+	{
+		static std::atomic<std::size_t> counter(0);
+		return ++counter;	//never 0, which marks an empty cache slot
+	}
+	//Block b is at (bx,by) in its level.  The slot comes from the low bits of bx and by rather than b, so any 2x2 group of blocks that a
+	//bilinear footprint can straddle lands in four different slots, whatever the width of the level is.
+	const uint8_t* decoded_block(std::size_t b,std::size_t bx,std::size_t by) const
+	{
+		static thread_local BlockCache cache;	//zero initialized, so every slot starts empty
+		std::size_t slot=((by & 7) << 3) | (bx & 7);
+		if(cache.ids[slot] != id || cache.keys[slot] != b)
+		{
+			Format::decode(&blocks[b*Format::BlockBytes],cache.texels[slot]);
+			cache.ids[slot]=id;
+			cache.keys[slot]=b;
+		}
+		return cache.texels[slot];
+	}
+	Sample fetch_texel(const Level& l,std::size_t x,std::size_t y) const
+	{
+		std::size_t bx=x/TILE,by=y/TILE;
+		const uint8_t* t=decoded_block(l.offset+by*l.tiles_x+bx,bx,by)+((y%TILE)*TILE+x%TILE)*Channels;
+		Sample s;
+		for(int c=0;c<Channels;c++)
+		{
+			s[c]=TexelTraits<uint8_t>::to_float(t[c]);
+		}
+		return s;
+	}
+	std::size_t add_level(std::size_t w,std::size_t h)
+	{
+		std::size_t nblocks=this->push_level(w,h,blocks.size()/Format::BlockBytes);
+		blocks.resize(blocks.size()+nblocks*Format::BlockBytes);
+		return levels.size()-1;
+	}
+public:
+	//Encodes every mip level of an uncompressed texture.  Texels past the edge of a partial block replicate the edge.
+	template<class T>
+	explicit CompressedTexture(const Texture<T,Channels>& src):
+		Base(src.wrap),
+		id(next_id())
+	{
+		for(std::size_t li=0;li<src.num_levels();li++)
+		{
+			const Level& sl=src.level(li);
+			const Level& l=levels[add_level(sl.width,sl.height)];
+			std::size_t by=(sl.height+TILE-1)/TILE;
+			#pragma omp parallel for
+			for(std::size_t b=0;b<l.tiles_x*by;b++)
+			{
+				std::size_t bx=b % l.tiles_x;
+				float texels[16*Channels];
+				for(std::size_t i=0;i<16;i++)
+				{
+					std::size_t x=std::min(bx*TILE+i%TILE,sl.width-1);
+					std::size_t y=std::min((b/l.tiles_x)*TILE+i/TILE,sl.height-1);
+					Eigen::Map<Sample>(texels+i*Channels)=src.texel(li,x,y);
+				}
+				Format::encode(texels,&blocks[(l.offset+b)*Format::BlockBytes]);
+			}
+		}
+	}
+	//Wraps already encoded data, for example produced offline by encode() or another BC encoder.
+	//The levels are expected back to back, each one in row-major block order, halving in size down to num_levels.
+	CompressedTexture(std::size_t w,std::size_t h,std::size_t num_levels,const uint8_t* data,TextureWrap wrp=TextureWrap::REPEAT):
+		Base(wrp),
+		id(next_id())
+	{
+		for(std::size_t li=0;li<num_levels;li++)
+		{
+			add_level(w,h);
+			w=std::max<std::size_t>(w/2,1);
+			h=std::max<std::size_t>(h/2,1);
+		}
+		std::copy(data,data+blocks.size(),blocks.begin());
+	}
+	CompressedTexture(const CompressedTexture& o):
+		Base(o),
+		blocks(o.blocks),
+		id(next_id())
+	{}
+	CompressedTexture& operator=(const CompressedTexture& o)
+	{
+		Base::operator=(o);
+		blocks=o.blocks;
+		id=next_id();
+		return *this;
+	}
+
+	//The raw encoded blocks of all levels, in the layout the wrapping constructor expects.
+	const uint8_t* data() const
+	{
+		return blocks.data();
+	}
+	std::size_t size_bytes() const
+	{
+		return blocks.size();
+	}
+};
+
+}
+
+#endif